@@ -0,0 +1,49 @@
+#include "stats.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// Replacement global operator new/delete that count allocations for
+// --stats. Kept apart from stats.cpp so that a program embedding the
+// library keeps its own allocator unless it asks for counting.
+
+static std::atomic<bool> g_countAllocations{false};
+extern std::atomic<uint64_t> g_allocations;
+extern std::atomic<uint64_t> g_bytesAllocated;
+
+static void *countedAlloc(size_t size) {
+    if (g_countAllocations.load(std::memory_order_relaxed)) {
+        g_allocations.fetch_add(1, std::memory_order_relaxed);
+        g_bytesAllocated.fetch_add(size, std::memory_order_relaxed);
+    }
+    return std::malloc(size ? size : 1);
+}
+
+void *operator new(size_t size) {
+    void *p = countedAlloc(size);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void *operator new[](size_t size) {
+    void *p = countedAlloc(size);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+    return countedAlloc(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+    return countedAlloc(size);
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+void operator delete[](void *p, size_t) noexcept { std::free(p); }
+
+void enableAllocationCounting() {
+    g_countAllocations.store(true, std::memory_order_relaxed);
+}
@@ -2,87 +2,451 @@
 #include "lexer.h"
 #include "encoder.h"
 #include "error.h"
-#include <fstream>
-#include <iomanip>
-#include <iostream>
+#include "source.h"
+#include "parallel.h"
+#include "deadcode.h"
+#include "layout.h"
+#include "peephole.h"
+#include "relax.h"
+#include "schedule.h"
+#include "output.h"
+#include <sys/stat.h>
+#include <algorithm>
+#include <deque>
 
-static std::string deriveOutputFilename(const std::string &input) {
+static std::string deriveOutputFilename(const std::string &input,
+                                        const char *extension) {
     size_t dot = input.rfind('.');
-    if (dot != std::string::npos) {
-        return input.substr(0, dot) + ".mif";
+    size_t slash = input.rfind('/');
+    if (dot != std::string::npos && (slash == std::string::npos || dot > slash)) {
+        return input.substr(0, dot) + extension;
     }
-    return input + ".mif";
+    return input + extension;
 }
 
-static void writeMIF(const std::vector<EncodedInst> &encoded,
-                      const std::string &outFile) {
-    std::ofstream out(outFile);
-    if (!out.is_open()) {
-        std::cerr << "Error: cannot open output file '" << outFile << "'"
-                  << std::endl;
-        return;
-    }
-
-    out << "WIDTH=32;" << std::endl;
-    out << "DEPTH=256;" << std::endl;
-    out << std::endl;
-    out << "ADDRESS_RADIX=HEX;" << std::endl;
-    out << "DATA_RADIX=HEX;" << std::endl;
-    out << std::endl;
-    out << "CONTENT BEGIN" << std::endl;
-
-    int numInstructions = static_cast<int>(encoded.size());
+// Lex, expand and encode one line at a time. Equivalent to the staged
+// pipeline below, but never holds the parsed program in memory.
+static std::vector<EncodedInst> assembleSinglePass(SourceBuffer &source,
+                                                   AssemblyStats *stats,
+                                                   SymbolTable *symbols,
+                                                   DataImage *data) {
+    StageTimer timer(stats, "singlePass");
+    LineLexer lexer(source);
+    StreamEncoder encoder;
+    ParsedLine line;
+    ParsedLine expanded[2];
+    size_t lines = 0, pseudos = 0;
 
-    for (int i = 0; i < numInstructions && i < 256; i++) {
-        out << "   ";
-        out << std::setw(3) << std::setfill('0') << std::hex << i;
-        out << "  :   ";
-        out << encoded[i].hex << ";";
-        if (!encoded[i].rawText.empty()) {
-            out << "  -- " << encoded[i].rawText;
+    while (!errorLimitReached() && lexer.next(line)) {
+        lines++;
+        resolveAliases(line);
+        if (isPseudo(line.mnemonic)) pseudos++;
+        size_t n = expandPseudo(line, expanded, source);
+        for (size_t i = 0; i < n; i++) {
+            encoder.add(expanded[i]);
         }
-        out << std::endl;
     }
 
-    if (numInstructions < 256) {
-        out << "   [";
-        out << std::setw(3) << std::setfill('0') << std::hex << numInstructions;
-        out << "..";
-        out << std::setw(3) << std::setfill('0') << std::hex << 255;
-        out << "]  :   00000000;" << std::endl;
+    if (stats) {
+        stats->lines = lines;
+        stats->pseudoExpansions = pseudos;
+        stats->labels = encoder.labelCount();
     }
+    std::vector<EncodedInst> encoded = encoder.finish(data);
+    if (symbols) *symbols = encoder.symbols();
+    return encoded;
+}
 
-    out << std::endl;
-    out << "END;";
-    out.close();
+// Whether the single-pass pipeline runs: the optional passes need the staged one
+static bool runsSinglePass(const AssemblerOptions &options) {
+    return options.singlePass && !options.optimize && !options.deadCode && !options.schedule &&
+           options.profile.empty();
 }
 
-bool assemble(const std::string &inputFile) {
-    resetErrors();
+// Everything besides the source bytes that decides the output image.
+// jobs is left out: it never changes the output. The single-pass pipeline
+// does not relax branches, so a branch out of reach fails there but not
+// in the staged one.
+static std::string outputFingerprint(const AssemblerOptions &options) {
+    const OutputOptions &output = options.output;
+    return std::string(ASSEMBLER_VERSION) + (runsSinglePass(options) ? " --single-pass" : "") +
+           (options.optimize ? " -O" : "") +
+           (options.deadCode ? " --dce" : "") +
+           (options.schedule ? " --schedule" : "") +
+           (options.sim.delaySlots ? " --delay-slots" : "") +
+           " format=" + std::to_string(static_cast<int>(output.format)) +
+           " endian=" + std::to_string(static_cast<int>(output.endian)) +
+           " width=" + std::to_string(output.mif.width) +
+           " depth=" + std::to_string(output.mif.depth);
+}
 
-    // Step 1: Tokenize
-    auto lines = tokenize(inputFile);
+bool assembleSource(SourceBuffer &source, const AssemblerOptions &options,
+                    std::vector<EncodedInst> &encoded, AssemblyStats *stats,
+                    SymbolTable *symbols, DataImage *data, ObjectModule *object) {
+    if (runsSinglePass(options) && !object) {
+        encoded = assembleSinglePass(source, stats, symbols, data);
+        return !hasErrors();
+    }
+
+    // Tokenize in place; tokens are views into the source
+    std::vector<ParsedLine> lines;
+    {
+        StageTimer timer(stats, "tokenize");
+        lines = tokenize(source);
+    }
     if (hasErrors()) return false;
+    if (stats) stats->lines = lines.size();
 
     // Step 2: Resolve register aliases ($zero -> $0, etc.)
-    resolveAliases(lines);
+    {
+        StageTimer timer(stats, "resolveAliases");
+        resolveAliases(lines);
+    }
 
     // Step 3: Expand pseudo-instructions (nop, move, li)
-    expandPseudos(lines);
+    {
+        StageTimer timer(stats, "expandPseudos");
+        size_t expanded = expandPseudos(lines, source);
+        if (stats) stats->pseudoExpansions = expanded;
+    }
 
-    // Step 4: Build label table
-    auto labels = buildLabelTable(lines);
+    // Step 4: Lower to the IR and bind labels
+    Program program;
+    {
+        StageTimer timer(stats, "buildProgram");
+        program = buildProgram(lines);
+    }
     if (hasErrors()) return false;
+    if (stats) stats->labels = program.symbols.definedCount();
 
-    // Step 5: Encode instructions
-    auto encoded = encode(lines, labels);
-    if (hasErrors()) return false;
+    // Optional: shrink the program before encoding
+    if (options.optimize) {
+        StageTimer timer(stats, "peephole");
+        PeepholeStats peephole = runPeephole(program);
+        if (stats) {
+            stats->peepholeRemoved = peephole.removed;
+            stats->peepholeRewritten = peephole.rewritten;
+        }
+    }
+
+    // Optional: drop code that never runs and results nobody reads
+    if (options.deadCode) {
+        DeadCodeStats dead;
+        {
+            StageTimer timer(stats, "deadCode");
+            dead = eliminateDeadCode(program, options.sim.delaySlots);
+        }
+        reportInfo("Dead code: " + std::to_string(dead.unreachable + dead.deadWrites) +
+                   " words saved (" + std::to_string(dead.unreachable) + " unreachable, " +
+                   std::to_string(dead.deadWrites) + " dead writes)");
+    }
+
+    // Optional: hide load-use stalls and fill delay slots
+    if (options.schedule) {
+        ScheduleStats sched;
+        {
+            StageTimer timer(stats, "schedule");
+            sched = runScheduler(program, options.sim.delaySlots);
+        }
+        size_t eliminated = sched.stallsBefore > sched.stallsAfter
+                                ? sched.stallsBefore - sched.stallsAfter : 0;
+        reportInfo("Scheduler: " + std::to_string(eliminated) + " of " +
+                   std::to_string(sched.stallsBefore) + " load-use stalls eliminated, " +
+                   std::to_string(sched.slotsFilled) + " delay slots filled");
+    }
+
+    // Optional: put each block's hottest successor right after it
+    if (!options.profile.empty()) {
+        LayoutStats layout;
+        {
+            StageTimer timer(stats, "layout");
+            std::vector<uint64_t> counts;
+            if (!readProfile(options.profile, program.symbols, program.insts.size(), counts)) {
+                return false;
+            }
+            layout = layoutBlocks(program, counts, options.sim.delaySlots, source);
+        }
+        if (layout.blocks == 0 && !program.insts.empty()) {
+            reportWarning(0, DiagCode::Other,
+                          "layout skipped: a branch or jump sits in a delay slot");
+        } else if (!layout.applied) {
+            reportInfo("Layout: no estimated gain, program left as it is (" +
+                       std::to_string(layout.executedBefore) + " instructions executed before, " +
+                       std::to_string(layout.executedAfter) + " with the best order found)");
+        } else {
+            reportInfo("Layout: " + std::to_string(layout.moved) + " of " +
+                       std::to_string(layout.blocks) + " blocks moved, " +
+                       std::to_string(layout.branchesInverted) + " branches inverted, " +
+                       std::to_string(layout.jumpsInserted) + " jumps inserted, " +
+                       std::to_string(layout.jumpsRemoved) + " removed");
+            reportInfo("Taken branches and jumps (estimated from the profile): " +
+                       std::to_string(layout.takenBefore) + " before, " +
+                       std::to_string(layout.takenAfter) + " after");
+            reportInfo("Instructions executed (estimated from the profile): " +
+                       std::to_string(layout.executedBefore) + " before, " +
+                       std::to_string(layout.executedAfter) + " after");
+        }
+    }
+
+    // Step 5: Rewrite branches that cannot reach their label
+    {
+        RelaxStats relax;
+        {
+            StageTimer timer(stats, "relax");
+            relax = relaxBranches(program, options.sim.delaySlots);
+        }
+        if (stats) stats->branchesRelaxed = relax.relaxed;
+        if (relax.relaxed > 0) {
+            reportInfo("Relaxation: " + std::to_string(relax.relaxed) +
+                       " out-of-range branches rewritten");
+        }
+    }
+
+    // Step 6: Place the .data segment after the final text (objects have none)
+    if (!object && (!program.data.empty() || !program.dataLabels.empty())) {
+        StageTimer timer(stats, "layoutData");
+        DataImage discarded;
+        layoutData(program.data, program.dataLabels,
+                   static_cast<uint32_t>(program.insts.size()), program.symbols,
+                   data ? *data : discarded);
+    }
+
+    // Step 7: Encode instructions
+    std::vector<Fixup> imports;
+    {
+        StageTimer timer(stats, "encode");
+        encoded = encode(program, options.jobs, object ? &imports : nullptr);
+    }
+    if (object) {
+        StageTimer timer(stats, "object");
+        *object = buildObject(program, imports);
+    }
+    if (symbols) *symbols = std::move(program.symbols);
+    return !hasErrors();
+}
+
+static void recordOutputSize(AssemblyStats *stats, const std::string &outFile) {
+    if (!stats) return;
+    struct stat st;
+    if (stat(outFile.c_str(), &st) == 0) stats->outputBytes = static_cast<uint64_t>(st.st_size);
+}
+
+// --estimate and --run on a finished image
+static void analyzeImage(const std::vector<EncodedInst> &encoded, const DataImage &data,
+                         const SymbolTable &symbols, const AssemblerOptions &options,
+                         AssemblyStats *stats) {
+    if (!options.run && !options.estimate) return;
+    std::vector<uint32_t> image;
+    image.reserve(encoded.size());
+    for (const auto &inst : encoded) image.push_back(inst.word);
+
+    if (options.estimate) {
+        CostEstimate estimate;
+        {
+            StageTimer timer(stats, "estimate");
+            estimate = estimateCost(image, options.cost);
+        }
+        reportEstimate(estimate, &symbols);
+    }
+    if (options.run) {
+        SimResult result;
+        {
+            StageTimer timer(stats, "run");
+            result = simulate(image, options.sim, &data);
+        }
+        reportSimulation(result, image);
+        if (!options.profileOut.empty()) writeProfile(result, options.profileOut);
+    }
+}
 
-    // Step 6: Write MIF output
-    std::string outFile = deriveOutputFilename(inputFile);
-    writeMIF(encoded, outFile);
+// -c: assemble to a relocatable object file next to the source
+static bool assembleObject(SourceBuffer &source, const std::string &inputFile,
+                           const AssemblerOptions &options, AssemblyStats *stats) {
+    std::string outFile = deriveOutputFilename(inputFile, ".obj");
+    std::vector<EncodedInst> encoded;
+    ObjectModule module;
+    if (!assembleSource(source, options, encoded, stats, nullptr, nullptr, &module)) return false;
+    if (stats) stats->instructions = encoded.size();
+    {
+        StageTimer timer(stats, "write");
+        if (!writeObject(encoded, module, inputFile, outFile)) return false;
+    }
+    recordOutputSize(stats, outFile);
+    reportInfo("Assembly complete: " + std::to_string(encoded.size()) + " instructions and " +
+               std::to_string(module.relocations.size()) + " relocations written to " + outFile);
+    return true;
+}
+
+bool assemble(const std::string &inputFile, const AssemblerOptions &options,
+              AssemblyStats *stats) {
+    resetErrors();
+    ErrorContext &errors = currentErrorContext();
+    errors.setOptions(options.diagnostics);
+    if (stats) stats->inputFile = inputFile;
+
+    // Step 1: Map the source
+    SourceBuffer source;
+    {
+        StageTimer timer(stats, "open");
+        if (!source.open(inputFile)) {
+            reportError(0, DiagCode::Io, "cannot open file '" + inputFile + "'");
+            return false;
+        }
+    }
+    // Columns are found in the source while it is mapped
+    errors.setSource(source.text(), inputFile);
+    struct SourceReset {
+        ErrorContext &errors;
+        const std::string &name;
+        ~SourceReset() { errors.setSource(std::string_view(), name); }
+    } sourceReset{errors, inputFile};
+
+    if (options.object) return assembleObject(source, inputFile, options, stats);
+
+    auto writer = makeImageWriter(options.output);
+    std::string outFile = deriveOutputFilename(inputFile, writer->extension());
+
+    // A source seen before with the same options needs no assembly
+    std::string cacheKey;
+    // (--run and --estimate need the encoded words, so they always assemble)
+    bool cacheable = options.cache && !options.run && !options.estimate && options.profile.empty();
+    if (cacheable) {
+        size_t cached = 0;
+        bool hit;
+        {
+            StageTimer timer(stats, "cacheLookup");
+            cacheKey = AssemblyCache::key(source.text(), outputFingerprint(options));
+            hit = options.cache->fetch(cacheKey, outFile, cached);
+        }
+        if (hit) {
+            if (stats) stats->instructions = cached;
+            reportInfo("Assembly complete: " + std::to_string(cached) +
+                       " instructions written to " + outFile + " (cached)");
+            return true;
+        }
+    }
+
+    std::vector<EncodedInst> encoded;
+    SymbolTable symbols;
+    DataImage data;
+    if (!assembleSource(source, options, encoded, stats, &symbols, &data)) return false;
+    if (stats) stats->instructions = encoded.size();
+
+    // Step 8: Write the output image (MIF unless another format was chosen)
+    {
+        StageTimer timer(stats, "write");
+        if (!writer->write(encoded, data, outFile)) return false;
+    }
+    // .incbin files are not part of the key, so such images are not kept
+    if (cacheable && !data.hasFiles()) {
+        StageTimer timer(stats, "cacheStore");
+        options.cache->store(cacheKey, outFile, encoded.size());
+    }
+    recordOutputSize(stats, outFile);
+
+    std::string summary = std::to_string(encoded.size()) + " instructions";
+    if (!data.empty()) summary += " and " + std::to_string(data.populatedBytes()) + " data bytes";
+    reportInfo("Assembly complete: " + summary + " written to " + outFile);
+
+    analyzeImage(encoded, data, symbols, options, stats);
+    return true;
+}
 
-    std::cout << "Assembly complete: " << encoded.size()
-              << " instructions written to " << outFile << std::endl;
+bool link(const std::vector<std::string> &objectFiles, std::string outFile,
+          const AssemblerOptions &options, AssemblyStats *stats) {
+    resetErrors();
+    currentErrorContext().setOptions(options.diagnostics);
+
+    // Objects are used where they are mapped, so they stay open until the
+    // image is written
+    std::deque<ObjectFile> files;
+    std::vector<const ObjectFile *> objects;
+    {
+        StageTimer timer(stats, "open");
+        bool opened = true;
+        for (const auto &path : objectFiles) {
+            files.emplace_back();
+            opened &= files.back().open(path);
+            objects.push_back(&files.back());
+        }
+        if (!opened) return false;
+    }
+
+    auto writer = makeImageWriter(options.output);
+    if (outFile.empty()) outFile = deriveOutputFilename(objectFiles[0], writer->extension());
+    if (stats) stats->inputFile = outFile;
+
+    std::vector<EncodedInst> image;
+    SymbolTable globals;
+    {
+        StageTimer timer(stats, "link");
+        if (!linkObjects(objects, image, globals)) return false;
+    }
+    if (stats) {
+        stats->instructions = image.size();
+        stats->labels = globals.definedCount();
+    }
+
+    DataImage data;
+    {
+        StageTimer timer(stats, "write");
+        if (!writer->write(image, data, outFile)) return false;
+    }
+    recordOutputSize(stats, outFile);
+    reportInfo("Link complete: " + std::to_string(image.size()) + " instructions from " +
+               std::to_string(objects.size()) + " objects written to " + outFile);
+
+    analyzeImage(image, data, globals, options, stats);
     return true;
 }
+
+int assembleBatch(const std::vector<std::string> &inputFiles,
+                  const AssemblerOptions &options,
+                  std::vector<AssemblyStats> *stats) {
+    size_t n = inputFiles.size();
+    if (stats) stats->assign(n, AssemblyStats());
+    std::vector<ErrorContext> contexts(n, ErrorContext(true));
+    std::vector<char> ok(n, 0);
+
+    // Files run one per thread; don't also split each file's encode stage
+    AssemblerOptions fileOptions = options;
+    fileOptions.jobs = 1;
+
+    // Start the largest files first so a big file doesn't become the tail
+    std::vector<std::pair<off_t, size_t>> order;
+    order.reserve(n);
+    for (size_t i = 0; i < n; i++) {
+        struct stat st;
+        off_t size = stat(inputFiles[i].c_str(), &st) == 0 ? st.st_size : 0;
+        order.push_back({size, i});
+    }
+    std::sort(order.begin(), order.end(), [](const auto &a, const auto &b) {
+        return a.first != b.first ? a.first > b.first : a.second < b.second;
+    });
+
+    {
+        unsigned threads = static_cast<unsigned>(
+            std::min<size_t>(std::max(options.jobs, 1u), n));
+        WorkStealingPool pool(threads);
+        for (const auto &entry : order) {
+            size_t i = entry.second;
+            contexts[i].setFile(inputFiles[i]);
+            pool.submit([&, i]() {
+                ErrorScope scope(contexts[i]);
+                ok[i] = assemble(inputFiles[i], fileOptions,
+                                 stats ? &(*stats)[i] : nullptr);
+            });
+        }
+        pool.wait();
+    }
+
+    int failures = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (!ok[i]) {
+            contexts[i].report(0, Severity::Error, DiagCode::Other, "assembly failed");
+            failures++;
+        }
+        contexts[i].flush();
+    }
+    return failures;
+}
@@ -1,8 +1,104 @@
-#ifndef ASSEMBLER_H
-#define ASSEMBLER_H
-
-#include <string>
-
-bool assemble(const std::string &inputFile);
-
-#endif
+#ifndef ASSEMBLER_H
+#define ASSEMBLER_H
+
+#include "cache.h"
+#include "error.h"
+#include "estimate.h"
+#include "object.h"
+#include "output.h"
+#include "sim.h"
+#include "source.h"
+#include "symtab.h"
+#include "stats.h"
+#include <string>
+#include <vector>
+
+// Part of every cache key, so a new assembler never reuses old images.
+// Bump whenever the encoding or an output format changes.
+constexpr const char *ASSEMBLER_VERSION = "mips32-asm 3";
+
+struct AssemblerOptions {
+    // Encode each line as it is lexed, patching forward references when
+    // their label appears, instead of running each stage over the program.
+    bool singlePass = false;
+
+    // Worker threads: for the encode stage of a single file, or for the
+    // whole batch when several files are assembled (1 = sequential).
+    unsigned jobs = 1;
+
+    // Run the peephole pass (-O): shorter li sequences, addu for moves, and
+    // no-op removal. Implies the staged pipeline even with singlePass.
+    bool optimize = false;
+
+    // Delete unreachable code and ALU writes nobody reads (--dce). Also
+    // implies the staged pipeline.
+    bool deadCode = false;
+
+    // Reorder within basic blocks to hide load-use stalls and fill branch
+    // delay slots (--schedule). Also implies the staged pipeline.
+    bool schedule = false;
+
+    // Execution profile to lay out basic blocks by (--profile), or empty.
+    // Implies the staged pipeline; images built with it are not cached.
+    std::string profile;
+
+    // Output format, and memory geometry for MIF
+    OutputOptions output;
+
+    // Write a relocatable object file (-c) instead of an image. Labels
+    // the source does not define become imports, bound by link().
+    bool object = false;
+
+    // Execute the image in the simulator after assembling (--run).
+    // sim.delaySlots also decides the long form of relaxed branches.
+    bool run = false;
+    SimOptions sim;
+    // Where --run writes its per-word counts (--profile-out), or empty
+    std::string profileOut;
+
+    // Report a static cycle estimate per block and loop (--estimate)
+    bool estimate = false;
+    CostModel cost;
+
+    // Error cap and deduplication for each file's diagnostics
+    DiagnosticOptions diagnostics;
+
+    // When set, reuse output images of unchanged sources (shared, not owned)
+    AssemblyCache *cache = nullptr;
+};
+
+// Run the pipeline from source text to encoded words, reporting into the
+// current error context. Nothing is written on disk; only .incbin reads
+// files. The encoded words, and the names in `symbols` if given, hold
+// views into `source`. The .data segment goes to `data` when given.
+// With `object`, undefined labels are left to the linker and `object`
+// receives the symbols and relocations (always the staged pipeline).
+bool assembleSource(SourceBuffer &source, const AssemblerOptions &options,
+                    std::vector<EncodedInst> &encoded,
+                    AssemblyStats *stats = nullptr,
+                    SymbolTable *symbols = nullptr,
+                    DataImage *data = nullptr,
+                    ObjectModule *object = nullptr);
+
+// When `stats` is given, per-stage timings, allocation counts and program
+// counts are recorded into it.
+bool assemble(const std::string &inputFile,
+              const AssemblerOptions &options = AssemblerOptions(),
+              AssemblyStats *stats = nullptr);
+
+// Link object files written with -c, in the given order, into one image
+// in options.output's format. An empty `outFile` is named after the first
+// object. --run and --estimate apply to the linked image.
+bool link(const std::vector<std::string> &objectFiles, std::string outFile,
+          const AssemblerOptions &options = AssemblerOptions(),
+          AssemblyStats *stats = nullptr);
+
+// Assemble each file on a work-stealing pool of options.jobs threads. Every
+// file gets its own error context; diagnostics are printed per file, in
+// input order, once all files are done. Returns the number of failures.
+// When `stats` is given it receives one entry per input, in input order.
+int assembleBatch(const std::vector<std::string> &inputFiles,
+                  const AssemblerOptions &options,
+                  std::vector<AssemblyStats> *stats = nullptr);
+
+#endif
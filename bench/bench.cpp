@@ -0,0 +1,256 @@
+// Per-stage throughput benchmark.
+//
+// Usage: bench <program.s>...
+//
+// Runs each stage of the assembler over every input and prints one JSON
+// object per input on stdout: seconds, lines/sec and bytes/sec per stage,
+// plus peak RSS. The single-pass pipeline is timed as a whole as well.
+//
+// "scan" compares the lexer front end per byte-class kernel (scalar, SSE2,
+// AVX2, whichever the CPU has): classifying the whole text, and tokenize
+// with that kernel. "reference" is the search-based line splitter the
+// kernels replaced, kept here as the baseline.
+#include "lexer.h"
+#include "scan.h"
+#include "encoder.h"
+#include "output.h"
+#include "source.h"
+#include "error.h"
+#include <sys/resource.h>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+static long peakRssKb() {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_maxrss;
+}
+
+struct Stage {
+    const char *name;
+    double seconds;
+    long peakRssKb;
+};
+
+template <typename F>
+static void timeStage(std::vector<Stage> &stages, const char *name, F &&fn) {
+    auto start = Clock::now();
+    fn();
+    std::chrono::duration<double> elapsed = Clock::now() - start;
+    stages.push_back({name, elapsed.count(), peakRssKb()});
+}
+
+static size_t countLines(std::string_view text) {
+    size_t n = 0;
+    for (char c : text) n += c == '\n';
+    if (!text.empty() && text.back() != '\n') n++;
+    return n;
+}
+
+static std::string_view trimBlank(std::string_view s) {
+    size_t start = s.find_first_not_of(" \t\r\n");
+    if (start == std::string_view::npos) return std::string_view();
+    size_t end = s.find_last_not_of(" \t\r\n");
+    return s.substr(start, end - start + 1);
+}
+
+// The former lexer: several searches and trims per line
+static std::vector<ParsedLine> referenceTokenize(std::string_view text) {
+    std::vector<ParsedLine> lines;
+    size_t pos = 0;
+    int lineNum = 0;
+    while (pos < text.size()) {
+        size_t eol = text.find('\n', pos);
+        if (eol == std::string_view::npos) eol = text.size();
+        std::string_view rawLine = text.substr(pos, eol - pos);
+        pos = eol + 1;
+        lineNum++;
+
+        std::string_view line = rawLine.substr(0, rawLine.find('#'));
+        line = trimBlank(line);
+        if (line.empty()) continue;
+
+        ParsedLine parsed = ParsedLine();
+        parsed.lineNumber = lineNum;
+        parsed.rawText = trimBlank(rawLine);
+        size_t colon = line.find(':');
+        if (colon != std::string_view::npos) {
+            parsed.label = trimBlank(line.substr(0, colon));
+            line = trimBlank(line.substr(colon + 1));
+            if (line.empty()) {
+                lines.push_back(parsed);
+                continue;
+            }
+        }
+        size_t space = line.find_first_of(" \t");
+        parsed.mnemonic = line.substr(0, space);
+        if (space != std::string_view::npos) {
+            std::string_view rest = trimBlank(line.substr(space));
+            auto addOperand = [&](std::string_view op) {
+                size_t open = op.find('('), close = op.find(')');
+                if (open != std::string_view::npos && close != std::string_view::npos &&
+                    close > open) {
+                    parsed.operands.push_back(trimBlank(op.substr(0, open)));
+                    parsed.operands.push_back(trimBlank(op.substr(open + 1, close - open - 1)));
+                } else {
+                    parsed.operands.push_back(op);
+                }
+            };
+            size_t start = 0;
+            int depth = 0;
+            for (size_t i = 0; i < rest.size(); i++) {
+                char c = rest[i];
+                if (c == '(') depth++;
+                if (c == ')') depth--;
+                if (c == ',' && depth == 0) {
+                    addOperand(trimBlank(rest.substr(start, i - start)));
+                    start = i + 1;
+                }
+            }
+            if (start < rest.size()) addOperand(trimBlank(rest.substr(start)));
+        }
+        lines.push_back(parsed);
+    }
+    return lines;
+}
+
+static double secondsOf(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// The "scan" object: reference and per-kernel front-end throughput
+static std::string benchScan(const SourceBuffer &source) {
+    std::string_view text = source.text();
+    double bytes = static_cast<double>(text.size());
+    char buf[256];
+
+    auto start = Clock::now();
+    size_t refLines = referenceTokenize(text).size();
+    double t = secondsOf(start);
+    std::snprintf(buf, sizeof(buf), "\"reference\":{\"tokenize_seconds\":%.6f,"
+                  "\"tokenize_bytes_per_sec\":%.0f}", t, bytes / (t > 0 ? t : 1e-9));
+    std::string out = buf;
+
+    ScanKernel original = scanKernel();
+    for (ScanKernel kernel : {ScanKernel::Scalar, ScanKernel::SSE2, ScanKernel::AVX2}) {
+        if (!setScanKernel(kernel)) continue;
+
+        // Classification alone, every full block once
+        start = Clock::now();
+        uint64_t sink = 0;
+        CharMasks masks;
+        for (size_t p = 0; p + 64 <= text.size(); p += 64) {
+            classifyBlock(text.data() + p, masks);
+            sink += masks.newline;
+        }
+        double classify = secondsOf(start);
+        volatile uint64_t keep = sink;   // so the loop is not optimized out
+        (void)keep;
+
+        start = Clock::now();
+        size_t lines = tokenize(source).size();
+        double tokenizeTime = secondsOf(start);
+        if (lines != refLines) {
+            std::fprintf(stderr, "bench: %s kernel found %zu lines, reference %zu\n",
+                         scanKernelName(kernel), lines, refLines);
+        }
+
+        std::snprintf(buf, sizeof(buf), ",\"%s\":{\"classify_bytes_per_sec\":%.0f,"
+                      "\"tokenize_seconds\":%.6f,\"tokenize_bytes_per_sec\":%.0f}",
+                      scanKernelName(kernel), bytes / (classify > 0 ? classify : 1e-9),
+                      tokenizeTime, bytes / (tokenizeTime > 0 ? tokenizeTime : 1e-9));
+        out += buf;
+    }
+    setScanKernel(original);
+    return out;
+}
+
+static bool benchFile(const std::string &path) {
+    resetErrors();
+    std::vector<Stage> stages;
+    SourceBuffer source;
+    if (!source.open(path)) {
+        std::fprintf(stderr, "bench: cannot open '%s'\n", path.c_str());
+        return false;
+    }
+    size_t bytes = source.text().size();
+    size_t lines = countLines(source.text());
+    std::string outFile = path + ".bench.mif";
+
+    std::vector<ParsedLine> parsed;
+    Program program;
+    std::vector<EncodedInst> encoded;
+
+    timeStage(stages, "tokenize", [&] { parsed = tokenize(source); });
+    timeStage(stages, "resolveAliases", [&] { resolveAliases(parsed); });
+    timeStage(stages, "expandPseudos", [&] { expandPseudos(parsed, source); });
+    timeStage(stages, "buildProgram", [&] { program = buildProgram(parsed); });
+    timeStage(stages, "encode", [&] { encoded = encode(program); });
+    timeStage(stages, "writeMIF", [&] {
+        MifOptions mif;
+        while (mif.depth < encoded.size()) mif.depth *= 2;
+        writeMIF(encoded, outFile, mif);
+    });
+    size_t instructions = encoded.size();
+
+    // Release the staged pipeline's memory before timing single-pass
+    std::vector<ParsedLine>().swap(parsed);
+    program = Program();
+    std::vector<EncodedInst>().swap(encoded);
+
+    timeStage(stages, "singlePass", [&] {
+        SourceBuffer again;
+        again.open(path);
+        LineLexer lexer(again);
+        StreamEncoder encoder;
+        ParsedLine line;
+        ParsedLine expanded[2];
+        while (lexer.next(line)) {
+            resolveAliases(line);
+            size_t n = expandPseudo(line, expanded, again);
+            for (size_t i = 0; i < n; i++) encoder.add(expanded[i]);
+        }
+        encoded = encoder.finish();
+    });
+    std::remove(outFile.c_str());
+    std::string scan = benchScan(source);
+
+    if (hasErrors()) {
+        std::fprintf(stderr, "bench: '%s' did not assemble cleanly\n", path.c_str());
+        return false;
+    }
+
+    double staged = 0;
+    std::printf("{\"file\":\"%s\",\"lines\":%zu,\"bytes\":%zu,\"instructions\":%zu,\"stages\":{",
+                path.c_str(), lines, bytes, instructions);
+    for (size_t i = 0; i < stages.size(); i++) {
+        const Stage &s = stages[i];
+        if (std::string(s.name) != "singlePass") staged += s.seconds;
+        double t = s.seconds > 0 ? s.seconds : 1e-9;
+        std::printf("%s\"%s\":{\"seconds\":%.6f,\"lines_per_sec\":%.0f,"
+                    "\"bytes_per_sec\":%.0f,\"peak_rss_kb\":%ld}",
+                    i ? "," : "", s.name, s.seconds, lines / t, bytes / t, s.peakRssKb);
+    }
+    double t = staged > 0 ? staged : 1e-9;
+    std::printf("},\"total\":{\"seconds\":%.6f,\"lines_per_sec\":%.0f,\"bytes_per_sec\":%.0f},"
+                "\"scan\":{%s},\"peak_rss_kb\":%ld}\n",
+                staged, lines / t, bytes / t, scan.c_str(), peakRssKb());
+    std::fflush(stdout);
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        std::fprintf(stderr, "Usage: %s <program.s>...\n", argv[0]);
+        return 1;
+    }
+    bool ok = true;
+    for (int i = 1; i < argc; i++) {
+        ok &= benchFile(argv[i]);
+    }
+    return ok ? 0 : 1;
+}
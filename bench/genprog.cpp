@@ -0,0 +1,161 @@
+// Synthetic program generator for the throughput benchmark.
+//
+// Usage: genprog <lines> [seed] > program.s
+//
+// Emits roughly <lines> source lines that exercise every operand pattern,
+// the pseudo-instructions, named and numeric register spellings, comments,
+// and dense labels with short forward and backward branches.
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+static uint64_t g_state = 0x9E3779B97F4A7C15ull;
+
+static uint32_t next() {
+    // xorshift64*
+    g_state ^= g_state >> 12;
+    g_state ^= g_state << 25;
+    g_state ^= g_state >> 27;
+    return static_cast<uint32_t>((g_state * 2685821657736338717ull) >> 32);
+}
+
+static uint32_t below(uint32_t n) {
+    return next() % n;
+}
+
+static const char *const NAMED[] = {
+    "$zero", "$at", "$v0", "$v1", "$a0", "$a1", "$a2", "$a3",
+    "$t0",   "$t1", "$t2", "$t3", "$t4", "$t5", "$t6", "$t7",
+    "$s0",   "$s1", "$s2", "$s3", "$s4", "$s5", "$s6", "$s7",
+    "$t8",   "$t9", "$k0", "$k1", "$gp", "$sp", "$fp", "$ra",
+};
+
+static const char *const R3[] = {"add", "addu", "sub", "subu", "and",
+                                 "or", "nor", "slt", "sltu"};
+static const char *const IMM[] = {"addi", "addiu", "andi", "ori", "slti", "sltiu"};
+static const char *const MEM[] = {"lw", "sw", "lbu", "lhu", "sb", "sh"};
+
+// Random register, spelled numerically, by name, or by upper-case name
+static std::string reg() {
+    uint32_t n = below(32);
+    switch (below(3)) {
+        case 0: return "$" + std::to_string(n);
+        case 1: return NAMED[n];
+        default: {
+            std::string s = NAMED[n];
+            for (char &c : s) c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+            return s;
+        }
+    }
+}
+
+static std::string imm16() {
+    char buf[16];
+    if (below(2)) std::snprintf(buf, sizeof(buf), "0x%04x", below(0x10000));
+    else std::snprintf(buf, sizeof(buf), "%d", static_cast<int>(below(0x8000)) - 0x4000);
+    return buf;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        std::fprintf(stderr, "Usage: %s <lines> [seed]\n", argv[0]);
+        return 1;
+    }
+    long total = std::strtol(argv[1], nullptr, 10);
+    if (argc > 2) g_state ^= std::strtoull(argv[2], nullptr, 10) * 0xBF58476D1CE4E5B9ull;
+    if (total <= 0) return 1;
+
+    // A label every LABEL_EVERY lines keeps branch targets dense
+    const long LABEL_EVERY = 4;
+    long numLabels = total / LABEL_EVERY + 1;
+    std::string out;
+    out.reserve(1 << 20);
+
+    auto emit = [&](const std::string &line) {
+        out += line;
+        out += '\n';
+        if (out.size() >= (1 << 20)) {
+            std::fwrite(out.data(), 1, out.size(), stdout);
+            out.clear();
+        }
+    };
+
+    // Branch target within +/-64 labels of label index `here`
+    auto nearLabel = [&](long here) {
+        long t = here + static_cast<long>(below(129)) - 64;
+        if (t < 0) t = 0;
+        if (t >= numLabels) t = numLabels - 1;
+        return "L" + std::to_string(t);
+    };
+
+    long label = 0;
+    for (long i = 0; i < total; i++) {
+        if (i % LABEL_EVERY == 0) {
+            // Alternate label-only lines and labels on an instruction
+            if (below(2)) {
+                emit("L" + std::to_string(label++) + ":");
+                continue;
+            }
+        }
+        std::string prefix;
+        if (i % LABEL_EVERY == 0) prefix = "L" + std::to_string(label++) + ": ";
+
+        std::string line;
+        switch (below(16)) {
+            case 0: case 1: case 2:
+                line = std::string(R3[below(9)]) + " " + reg() + ", " + reg() + ", " + reg();
+                break;
+            case 3:
+                line = std::string(below(2) ? "sll" : "srl") + " " + reg() + ", " +
+                       reg() + ", " + std::to_string(below(32));
+                break;
+            case 4: case 5: case 6:
+                line = std::string(IMM[below(6)]) + " " + reg() + ", " + reg() + ", " + imm16();
+                break;
+            case 7:
+                line = "lui " + reg() + ", " + imm16();
+                break;
+            case 8: case 9:
+                line = std::string(MEM[below(6)]) + " " + reg() + ", " +
+                       std::to_string(below(256)) + "(" + reg() + ")";
+                break;
+            case 10: case 11:
+                line = std::string(below(2) ? "beq" : "bne") + " " + reg() + ", " +
+                       reg() + ", " + nearLabel(label);
+                break;
+            case 12:
+                line = std::string(below(2) ? "j" : "jal") + " " + nearLabel(label);
+                break;
+            case 13:
+                line = "jr " + reg();
+                break;
+            case 14:
+                switch (below(3)) {
+                    case 0: line = "nop"; break;
+                    case 1: line = "move " + reg() + ", " + reg(); break;
+                    default: {
+                        char buf[16];
+                        std::snprintf(buf, sizeof(buf), "0x%08x", next());
+                        line = "li " + reg() + ", " + (below(2) ? std::string(buf) : imm16());
+                        break;
+                    }
+                }
+                break;
+            default:
+                line = std::string(R3[below(9)]) + " " + reg() + ", " + reg() + ", " +
+                       reg() + "   # trailing comment";
+                break;
+        }
+        emit(prefix + line);
+    }
+    // Make sure every label a branch may name exists
+    while (label < numLabels) {
+        emit("L" + std::to_string(label++) + ":");
+    }
+    emit("nop");
+
+    std::fwrite(out.data(), 1, out.size(), stdout);
+    return 0;
+}
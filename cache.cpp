@@ -0,0 +1,202 @@
+#include "cache.h"
+#include "source.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <vector>
+
+static const char ENTRY_MAGIC[] = "MIPSCACHE";
+static const char TEMP_PREFIX[] = ".tmp-";
+static const size_t KEY_LENGTH = 32;   // hex digits
+
+// Temporary files older than this were left by a process that died
+static const time_t STALE_TEMP_SECONDS = 3600;
+
+// Two independent 64-bit lanes over 8-byte words. Not cryptographic, but
+// 128 bits is plenty to tell real source files apart.
+struct Hash128 {
+    uint64_t a = 0x9E3779B97F4A7C15ull;
+    uint64_t b = 0xC2B2AE3D27D4EB4Full;
+
+    static uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+    static uint64_t fmix(uint64_t k) {
+        k ^= k >> 33;
+        k *= 0xFF51AFD7ED558CCDull;
+        k ^= k >> 33;
+        k *= 0xC4CEB9FE1A85EC53ull;
+        k ^= k >> 33;
+        return k;
+    }
+
+    void word(uint64_t w) {
+        a = rotl(a ^ (w * 0x87C37B91114253D5ull), 31) * 0x4CF5AD432745937Full;
+        b = rotl(b ^ (w * 0x4CF5AD432745937Full), 29) * 0x87C37B91114253D5ull + a;
+    }
+
+    void update(std::string_view s) {
+        size_t i = 0;
+        for (; i + 8 <= s.size(); i += 8) {
+            uint64_t w;
+            std::memcpy(&w, s.data() + i, 8);
+            word(w);
+        }
+        uint64_t tail = 0;
+        std::memcpy(&tail, s.data() + i, s.size() - i);
+        word(tail);
+        word(s.size());
+    }
+
+    std::string hex() const {
+        char buf[33];
+        std::snprintf(buf, sizeof(buf), "%016" PRIx64 "%016" PRIx64,
+                      fmix(a + b), fmix(b ^ rotl(a, 17)));
+        return buf;
+    }
+};
+
+AssemblyCache::AssemblyCache(std::string dir, uint64_t maxBytes)
+    : dir_(std::move(dir)), maxBytes_(maxBytes) {
+    while (dir_.size() > 1 && dir_.back() == '/') dir_.pop_back();
+}
+
+bool AssemblyCache::open() {
+    if (mkdir(dir_.c_str(), 0777) != 0 && errno != EEXIST) return false;
+    struct stat st;
+    return stat(dir_.c_str(), &st) == 0 && S_ISDIR(st.st_mode) &&
+           access(dir_.c_str(), R_OK | W_OK | X_OK) == 0;
+}
+
+std::string AssemblyCache::key(std::string_view source, std::string_view fingerprint) {
+    Hash128 h;
+    h.update(fingerprint);
+    h.update(source);
+    return h.hex();
+}
+
+std::string AssemblyCache::entryPath(const std::string &key) const {
+    return dir_ + "/" + key;
+}
+
+bool AssemblyCache::fetch(const std::string &key, const std::string &outFile,
+                          size_t &instructions) {
+    std::string path = entryPath(key);
+    SourceBuffer entry;
+    if (!entry.open(path)) {
+        misses_++;
+        return false;
+    }
+
+    // Header: "MIPSCACHE <instructions> <image bytes>\n"
+    std::string_view text = entry.text();
+    size_t newline = text.find('\n');
+    unsigned long long count = 0, bytes = 0;
+    char magic[16] = {};
+    std::string header(text.substr(0, newline == std::string_view::npos ? 0 : newline));
+    if (newline == std::string_view::npos ||
+        std::sscanf(header.c_str(), "%15s %llu %llu", magic, &count, &bytes) != 3 ||
+        std::strcmp(magic, ENTRY_MAGIC) != 0 || text.size() - newline - 1 != bytes) {
+        misses_++;
+        return false;
+    }
+
+    std::FILE *f = std::fopen(outFile.c_str(), "wb");
+    if (!f) {
+        misses_++;
+        return false;
+    }
+    bool ok = std::fwrite(text.data() + newline + 1, 1, bytes, f) == bytes;
+    ok &= std::fclose(f) == 0;
+    if (!ok) {
+        misses_++;
+        return false;
+    }
+
+    // Mark as recently used for eviction
+    utimensat(AT_FDCWD, path.c_str(), nullptr, 0);
+    instructions = static_cast<size_t>(count);
+    hits_++;
+    return true;
+}
+
+void AssemblyCache::store(const std::string &key, const std::string &outFile,
+                          size_t instructions) {
+    SourceBuffer image;
+    if (!image.open(outFile)) return;
+    std::string_view bytes = image.text();
+
+    std::string temp = dir_ + "/" + TEMP_PREFIX + std::to_string(getpid()) + "-" +
+                       std::to_string(tempCounter_++);
+    int fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0666);
+    if (fd < 0) return;
+
+    char header[64];
+    int len = std::snprintf(header, sizeof(header), "%s %zu %zu\n", ENTRY_MAGIC,
+                            instructions, bytes.size());
+    bool ok = ::write(fd, header, len) == len;
+    size_t done = 0;
+    while (ok && done < bytes.size()) {
+        ssize_t n = ::write(fd, bytes.data() + done, bytes.size() - done);
+        if (n <= 0) ok = false;
+        else done += static_cast<size_t>(n);
+    }
+    ok &= ::close(fd) == 0;
+
+    // rename() replaces atomically, so readers never see a partial entry
+    if (!ok || std::rename(temp.c_str(), entryPath(key).c_str()) != 0) {
+        unlink(temp.c_str());
+    }
+}
+
+void AssemblyCache::trim() {
+    DIR *d = opendir(dir_.c_str());
+    if (!d) return;
+
+    struct Entry {
+        std::string path;
+        uint64_t size;
+        struct timespec used;
+    };
+    std::vector<Entry> entries;
+    uint64_t total = 0;
+    time_t now = std::time(nullptr);
+
+    while (struct dirent *de = readdir(d)) {
+        if (de->d_name[0] == '.' && std::strncmp(de->d_name, TEMP_PREFIX,
+                                                 sizeof(TEMP_PREFIX) - 1) != 0) {
+            continue;
+        }
+        std::string path = dir_ + "/" + de->d_name;
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) continue;
+
+        if (de->d_name[0] == '.') {
+            if (now - st.st_mtime > STALE_TEMP_SECONDS) unlink(path.c_str());
+            continue;
+        }
+        if (std::strlen(de->d_name) != KEY_LENGTH) continue;
+        entries.push_back({path, static_cast<uint64_t>(st.st_size), st.st_mtim});
+        total += static_cast<uint64_t>(st.st_size);
+    }
+    closedir(d);
+
+    if (total <= maxBytes_) return;
+
+    std::sort(entries.begin(), entries.end(), [](const Entry &x, const Entry &y) {
+        if (x.used.tv_sec != y.used.tv_sec) return x.used.tv_sec < y.used.tv_sec;
+        return x.used.tv_nsec < y.used.tv_nsec;
+    });
+    for (const Entry &e : entries) {
+        if (total <= maxBytes_) break;
+        // Another process may have evicted it already; either way it's gone
+        unlink(e.path.c_str());
+        total -= e.size;
+    }
+}
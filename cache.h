@@ -0,0 +1,50 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Directory of previously assembled output images, keyed by a hash of the
+// source bytes, the assembler version and every option that changes the
+// output. Entries are written to a temporary file and renamed into place,
+// so several processes can share one directory: a reader sees either a
+// whole entry or none. An entry's mtime is its last use; trim() removes
+// the least recently used entries until the directory fits its budget.
+class AssemblyCache {
+public:
+    AssemblyCache(std::string dir, uint64_t maxBytes);
+
+    // Create the directory if needed. False if it is not usable.
+    bool open();
+
+    // Key for a source assembled with the given options fingerprint.
+    static std::string key(std::string_view source, std::string_view fingerprint);
+
+    // On a hit, write the stored image to outFile, set `instructions` and
+    // mark the entry as recently used.
+    bool fetch(const std::string &key, const std::string &outFile, size_t &instructions);
+
+    // Copy a freshly written output file into the cache. Failures are
+    // silent: the cache is only an accelerator.
+    void store(const std::string &key, const std::string &outFile, size_t instructions);
+
+    // Evict least recently used entries until the total is within budget.
+    void trim();
+
+    uint64_t hits() const { return hits_.load(); }
+    uint64_t misses() const { return misses_.load(); }
+
+private:
+    std::string entryPath(const std::string &key) const;
+
+    std::string dir_;
+    uint64_t maxBytes_;
+    std::atomic<uint64_t> hits_{0};
+    std::atomic<uint64_t> misses_{0};
+    std::atomic<uint64_t> tempCounter_{0};
+};
+
+#endif
@@ -0,0 +1,274 @@
+#include "data.h"
+#include "error.h"
+#include "lexer.h"
+#include <algorithm>
+#include <cstdio>
+
+// Data addresses are kept below 2 GiB so every one fits a symbol's int
+static const uint64_t DATA_LIMIT = 0x80000000ull;
+
+uint8_t *DataImage::allocate(uint32_t address, size_t n) {
+    if (n == 0) return nullptr;
+    if (!chunks_.empty()) {
+        Chunk &last = chunks_.back();
+        if (static_cast<uint64_t>(last.address) + last.bytes.size() == address) {
+            size_t old = last.bytes.size();
+            last.bytes.resize(old + n, '\0');
+            return reinterpret_cast<uint8_t *>(&last.bytes[old]);
+        }
+    }
+    chunks_.push_back({address, std::string(n, '\0')});
+    return reinterpret_cast<uint8_t *>(&chunks_.back().bytes[0]);
+}
+
+bool DataImage::map(uint32_t address, const std::string &path, size_t &size) {
+    auto buffer = std::make_unique<SourceBuffer>();
+    if (!buffer->open(path)) return false;
+    size = buffer->text().size();
+    if (size > 0) files_.push_back({address, std::move(buffer)});
+    return true;
+}
+
+std::vector<Extent> DataImage::extents() const {
+    std::vector<Extent> out;
+    out.reserve(chunks_.size() + files_.size());
+    for (const auto &c : chunks_) out.push_back({c.address, c.bytes});
+    for (const auto &f : files_) out.push_back({f.address, f.buffer->text()});
+    std::sort(out.begin(), out.end(),
+              [](const Extent &a, const Extent &b) { return a.address < b.address; });
+    return out;
+}
+
+uint64_t DataImage::populatedBytes() const {
+    uint64_t n = 0;
+    for (const auto &c : chunks_) n += c.bytes.size();
+    for (const auto &f : files_) n += f.buffer->text().size();
+    return n;
+}
+
+void DataImage::clear() {
+    chunks_.clear();
+    files_.clear();
+}
+
+static std::string_view trim(std::string_view s) {
+    size_t start = s.find_first_not_of(" \t");
+    if (start == std::string_view::npos) return std::string_view();
+    size_t end = s.find_last_not_of(" \t");
+    return s.substr(start, end - start + 1);
+}
+
+std::vector<std::string_view> splitDataArgs(std::string_view args) {
+    std::vector<std::string_view> items;
+    args = trim(args);
+    if (args.empty()) return items;
+    size_t start = 0;
+    for (;;) {
+        size_t comma = args.find(',', start);
+        items.push_back(trim(args.substr(start, comma == std::string_view::npos
+                                                    ? std::string_view::npos
+                                                    : comma - start)));
+        if (comma == std::string_view::npos) break;
+        start = comma + 1;
+    }
+    return items;
+}
+
+static const char *directiveName(DataDirective::Kind kind) {
+    switch (kind) {
+        case DataDirective::Kind::Org:    return ".org";
+        case DataDirective::Kind::Word:   return ".word";
+        case DataDirective::Kind::Half:   return ".half";
+        case DataDirective::Kind::Byte:   return ".byte";
+        case DataDirective::Kind::Space:  return ".space";
+        case DataDirective::Kind::Align:  return ".align";
+        case DataDirective::Kind::Incbin: return ".incbin";
+    }
+    return ".?";
+}
+
+static unsigned itemSize(DataDirective::Kind kind) {
+    switch (kind) {
+        case DataDirective::Kind::Word: return 4;
+        case DataDirective::Kind::Half: return 2;
+        case DataDirective::Kind::Byte: return 1;
+        default:                        return 0;
+    }
+}
+
+// One non-negative integer argument
+static bool countArgument(const DataDirective &d, uint64_t &value) {
+    int32_t v;
+    std::string_view arg = trim(d.args);
+    if (!parseInteger(arg, v)) {
+        reportError(d.lineNumber, DiagCode::BadDirective, std::string(directiveName(d.kind)) +
+                    " needs an integer, got '" + std::string(arg) + "'");
+        return false;
+    }
+    // Hex literals are bit patterns, so 0x80000000 parses negative
+    bool hex = arg.size() > 2 && arg[0] == '0' && (arg[1] == 'x' || arg[1] == 'X');
+    if (v < 0 && !hex) {
+        reportError(d.lineNumber, DiagCode::BadDirective, std::string(directiveName(d.kind)) +
+                    " must not be negative");
+        return false;
+    }
+    value = static_cast<uint32_t>(v);
+    return true;
+}
+
+static std::string hexAddress(uint64_t address) {
+    char buf[24];
+    std::snprintf(buf, sizeof(buf), "0x%llx", static_cast<unsigned long long>(address));
+    return buf;
+}
+
+void layoutData(const std::vector<DataDirective> &directives,
+                const std::vector<DataLabel> &labels, uint32_t textWords,
+                SymbolTable &symbols, DataImage &image) {
+    uint64_t textEnd = static_cast<uint64_t>(textWords) * 4;
+    uint64_t loc = textEnd;
+    size_t nextLabel = 0;
+
+    auto defineLabels = [&](uint32_t directive, uint64_t address) {
+        for (; nextLabel < labels.size() && labels[nextLabel].directive <= directive; nextLabel++) {
+            const DataLabel &label = labels[nextLabel];
+            if (symbols.isDefined(label.symbol)) {
+                reportError(label.lineNumber, DiagCode::DuplicateLabel, "duplicate label '" +
+                            std::string(symbols.name(label.symbol)) + "'");
+                continue;
+            }
+            symbols.defineData(label.symbol, static_cast<int>(address));
+        }
+    };
+
+    // Pass 1: addresses and sizes, so .word can name any data label
+    std::vector<uint64_t> starts(directives.size(), 0);
+    std::vector<uint64_t> sizes(directives.size(), 0);
+    std::vector<std::vector<std::string_view>> items(directives.size());
+    for (uint32_t i = 0; i < directives.size(); i++) {
+        const DataDirective &d = directives[i];
+        switch (d.kind) {
+            case DataDirective::Kind::Org: {
+                uint64_t address;
+                if (countArgument(d, address)) loc = address;
+                break;
+            }
+            case DataDirective::Kind::Word:
+            case DataDirective::Kind::Half:
+            case DataDirective::Kind::Byte: {
+                unsigned size = itemSize(d.kind);
+                loc = (loc + size - 1) & ~static_cast<uint64_t>(size - 1);
+                items[i] = splitDataArgs(d.args);
+                if (items[i].empty()) {
+                    reportError(d.lineNumber, DiagCode::BadDirective,
+                                std::string(directiveName(d.kind)) + " needs at least one value");
+                }
+                sizes[i] = static_cast<uint64_t>(items[i].size()) * size;
+                break;
+            }
+            case DataDirective::Kind::Space: {
+                uint64_t n;
+                if (countArgument(d, n)) sizes[i] = n;
+                break;
+            }
+            case DataDirective::Kind::Align: {
+                uint64_t n;
+                if (!countArgument(d, n)) break;
+                if (n > 30) {
+                    reportError(d.lineNumber, DiagCode::BadDirective,
+                                ".align " + std::to_string(n) + " is too large");
+                    break;
+                }
+                uint64_t unit = 1ull << n;
+                loc = (loc + unit - 1) & ~(unit - 1);
+                break;
+            }
+            case DataDirective::Kind::Incbin: {
+                std::string path(trim(d.args));
+                if (path.size() >= 2 && path.front() == '"' && path.back() == '"') {
+                    path = path.substr(1, path.size() - 2);
+                }
+                size_t size = 0;
+                if (loc >= DATA_LIMIT) break;   // reported below
+                if (path.empty()) {
+                    reportError(d.lineNumber, DiagCode::BadDirective, ".incbin needs a file name");
+                } else if (!image.map(static_cast<uint32_t>(loc), path, size)) {
+                    reportError(d.lineNumber, DiagCode::Io, "cannot open file '" + path + "'");
+                }
+                sizes[i] = size;
+                break;
+            }
+        }
+        starts[i] = loc;
+        loc += sizes[i];
+        if (loc > DATA_LIMIT) {
+            reportError(d.lineNumber, DiagCode::AddressRange, "data ends at " + hexAddress(loc) +
+                        ", beyond the 2 GiB data space");
+            return;
+        }
+        defineLabels(i, starts[i]);
+    }
+    defineLabels(static_cast<uint32_t>(directives.size()), loc);
+
+    // Nothing may overlap the text or other initialized data
+    struct Span {
+        uint64_t begin, end;
+        int lineNumber;   // 0 for the text
+    };
+    std::vector<Span> spans;
+    if (textEnd > 0) spans.push_back({0, textEnd, 0});
+    for (size_t i = 0; i < directives.size(); i++) {
+        DataDirective::Kind kind = directives[i].kind;
+        if (sizes[i] == 0 || kind == DataDirective::Kind::Space) continue;
+        spans.push_back({starts[i], starts[i] + sizes[i], directives[i].lineNumber});
+    }
+    std::stable_sort(spans.begin(), spans.end(),
+                     [](const Span &a, const Span &b) { return a.begin < b.begin; });
+    for (size_t i = 1; i < spans.size(); i++) {
+        const Span &prev = spans[i - 1], &cur = spans[i];
+        if (cur.begin >= prev.end) continue;
+        const Span &later = prev.lineNumber == 0 || cur.lineNumber > prev.lineNumber ? cur : prev;
+        const Span &other = &later == &cur ? prev : cur;
+        reportError(later.lineNumber, DiagCode::Overlap,
+                    "data at " + hexAddress(later.begin) + " overlaps " +
+                    (other.lineNumber == 0 ? std::string("the program text")
+                                           : "data from line " + std::to_string(other.lineNumber)));
+    }
+
+    // Pass 2: values, written big-endian like the simulator's memory
+    for (size_t i = 0; i < directives.size(); i++) {
+        const DataDirective &d = directives[i];
+        unsigned size = itemSize(d.kind);
+        if (size == 0 || sizes[i] == 0) continue;
+        uint8_t *out = image.allocate(static_cast<uint32_t>(starts[i]),
+                                      static_cast<size_t>(sizes[i]));
+        for (std::string_view item : items[i]) {
+            int32_t v;
+            uint32_t value = 0;
+            if (parseInteger(item, v)) {
+                value = static_cast<uint32_t>(v);
+                bool fits = size == 4 || (size == 2 ? v >= -32768 && v <= 65535
+                                                    : v >= -128 && v <= 255);
+                if (!fits) {
+                    reportError(d.lineNumber, DiagCode::BadDirective, "value '" +
+                                std::string(item) + "' does not fit " + directiveName(d.kind));
+                }
+            } else if (d.kind == DataDirective::Kind::Word && !item.empty()) {
+                uint32_t id = symbols.find(item);
+                if (id == SymbolTable::NONE || !symbols.isDefined(id)) {
+                    reportError(d.lineNumber, DiagCode::UndefinedLabel, "undefined label '" +
+                                std::string(item) + "'");
+                } else {
+                    value = static_cast<uint32_t>(symbols.address(id));
+                }
+            } else {
+                reportError(d.lineNumber, DiagCode::BadDirective, "invalid value '" +
+                            std::string(item) + "'");
+            }
+            for (unsigned b = 0; b < size; b++) {
+                out[b] = static_cast<uint8_t>(value >> (8 * (size - 1 - b)));
+            }
+            out += size;
+        }
+    }
+}
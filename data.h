@@ -0,0 +1,105 @@
+#ifndef DATA_H
+#define DATA_H
+
+#include "source.h"
+#include "symtab.h"
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// One directive from the .data segment. Arguments stay as written (the
+// lexer keeps a directive's operands as one string) and are parsed when
+// the segment is laid out.
+struct DataDirective {
+    enum class Kind : uint8_t {
+        Org,      // .org addr, or .data addr
+        Word,     // .word v, ... (labels allowed)
+        Half,     // .half v, ...
+        Byte,     // .byte v, ...
+        Space,    // .space n: n zero bytes
+        Align,    // .align n: next multiple of 2^n bytes
+        Incbin,   // .incbin "file"
+    };
+
+    Kind kind;
+    std::string_view args;
+    int lineNumber;
+};
+
+// A contiguous run of initialized bytes at a byte address.
+struct Extent {
+    uint32_t address;
+    std::string_view bytes;
+};
+
+// Sparse byte image of the .data segment: a list of extents, so a large
+// address space with little in it costs only what is populated. Bytes
+// are either owned or views of a memory-mapped .incbin file; untouched
+// addresses read as zero.
+class DataImage {
+public:
+    // `n` zeroed bytes at `address` to fill in. Consecutive calls at
+    // adjacent addresses grow one extent.
+    uint8_t *allocate(uint32_t address, size_t n);
+
+    // Map `path` at `address` without copying it. Returns false if the
+    // file cannot be opened; `size` receives its length.
+    bool map(uint32_t address, const std::string &path, size_t &size);
+
+    // Extents in address order; they never overlap.
+    std::vector<Extent> extents() const;
+
+    bool empty() const { return chunks_.empty() && files_.empty(); }
+    uint64_t populatedBytes() const;
+
+    // True if some bytes came from files, so the image depends on more
+    // than the source text.
+    bool hasFiles() const { return !files_.empty(); }
+
+    void clear();
+
+private:
+    struct Chunk {
+        uint32_t address;
+        std::string bytes;
+    };
+    struct File {
+        uint32_t address;
+        std::unique_ptr<SourceBuffer> buffer;
+    };
+
+    std::deque<Chunk> chunks_;
+    std::deque<File> files_;
+};
+
+// True for ".word", ".data" and every other dot-prefixed mnemonic.
+inline bool isDirective(std::string_view mnemonic) {
+    return !mnemonic.empty() && mnemonic[0] == '.';
+}
+
+// The comma-separated items of a directive's arguments, trimmed; an empty
+// list has no items.
+std::vector<std::string_view> splitDataArgs(std::string_view args);
+
+// Label in the .data segment; it names the directive it precedes.
+struct DataLabel {
+    uint32_t symbol;
+    uint32_t directive;   // index into the directives (size() for the end)
+    int lineNumber;
+};
+
+// Place the .data segment after `textWords` instructions (at the next word
+// boundary, in bytes) unless .org moves it, define every data label to its
+// byte address, and fill `image`. .word and .half are aligned to their
+// size. Text labels must already be bound, since .word may name them.
+// Reports bad arguments, overlaps with the text or other data, and data
+// labels that clash with another label.
+void layoutData(const std::vector<DataDirective> &directives,
+                const std::vector<DataLabel> &labels, uint32_t textWords,
+                SymbolTable &symbols, DataImage &image);
+
+#endif
@@ -0,0 +1,213 @@
+#include "deadcode.h"
+#include <cstdint>
+#include <vector>
+
+namespace {
+
+constexpr uint32_t NONE = UINT32_MAX;
+constexpr uint32_t ALL_REGISTERS = 0xFFFFFFFFu;
+
+// Where execution may go after an instruction
+struct Flow {
+    uint32_t target = NONE;   // instruction a branch or jump names
+    bool falls = true;        // on to the next word
+    bool exits = false;       // somewhere every register may be read
+};
+
+bool is(const IRInst &inst, const char *mnemonic) {
+    return inst.def->mnemonic == mnemonic;
+}
+
+// Arithmetic that traps on signed overflow, so it has an effect even when
+// the result is discarded
+bool canTrap(const IRInst &inst) {
+    return is(inst, "add") || is(inst, "sub") || is(inst, "addi");
+}
+
+} // namespace
+
+DeadCodeStats eliminateDeadCode(Program &program, bool delaySlots) {
+    DeadCodeStats stats;
+    auto &insts = program.insts;
+    uint32_t n = static_cast<uint32_t>(insts.size());
+    if (n == 0) return stats;
+
+    std::vector<uint32_t> labelAt(program.symbols.size(), NONE);
+    std::vector<char> labeled(n + 1, 0);
+    for (const auto &label : program.labels) {
+        labelAt[label.symbol] = label.index;
+        labeled[label.index] = 1;
+    }
+
+    // Where each branch or jump goes, ignoring delay slots
+    std::vector<RegisterEffects> fx(n);
+    std::vector<Flow> jumps(n);
+    bool indirect = false;
+    for (uint32_t i = 0; i < n; i++) {
+        fx[i] = effectsOf(program, insts[i]);
+        if (fx[i].opaque) return stats;
+        if (!fx[i].control) continue;
+        if (delaySlots && i > 0 && fx[i - 1].control) return stats;
+
+        const Operand *ops = program.operandsOf(insts[i]);
+        Flow &f = jumps[i];
+        const Operand *label;
+        switch (insts[i].def->pattern) {
+            case OperandPattern::R_SRC_ONLY:
+                f.falls = false;
+                f.exits = true;
+                if (ops[0].value != 31) indirect = true;
+                continue;
+            case OperandPattern::I_SRC_TMP_LABEL:
+                // beq $x,$x always branches; bne $x,$x never does
+                if (ops[0].value == ops[1].value) {
+                    if (is(insts[i], "bne")) continue;
+                    f.falls = false;
+                }
+                label = &ops[2];
+                break;
+            default:
+                f.falls = is(insts[i], "jal");   // the call returns to the next word
+                label = &ops[0];
+                break;
+        }
+        if (label->kind != Operand::Kind::Symbol) return stats;
+        uint32_t at = labelAt[label->value];
+        if (at < n) f.target = at;
+        // An import, the end of the program, or a halt
+        if (at >= n || at == i) f.exits = true;
+    }
+
+    // With delay slots a branch always runs its slot, and the slot goes on
+    // where the branch does (or to the next word, if jumped to directly)
+    std::vector<Flow> flow(n);
+    std::vector<char> inSlot(n, 0);
+    for (uint32_t i = 0; i < n; i++) {
+        if (!delaySlots) {
+            flow[i] = jumps[i];
+        } else if (i > 0 && fx[i - 1].control) {
+            inSlot[i] = 1;
+            flow[i] = jumps[i - 1];
+            flow[i].falls |= labeled[i] != 0;
+        }
+        if (flow[i].falls && i + 1 == n) flow[i].exits = true;
+    }
+    if (delaySlots && fx[n - 1].control) {
+        // The slot would be past the end
+        flow[n - 1].target = jumps[n - 1].target;
+        flow[n - 1].exits = true;
+    }
+
+    // Reachability from every entry
+    std::vector<char> reached(n, 0);
+    std::vector<uint32_t> stack;
+    auto enter = [&](uint32_t i) {
+        if (i < n && !reached[i]) {
+            reached[i] = 1;
+            stack.push_back(i);
+        }
+    };
+    enter(0);
+    for (const auto &global : program.globals) enter(labelAt[global.symbol]);
+    for (const auto &d : program.data) {
+        if (d.kind != DataDirective::Kind::Word) continue;
+        for (std::string_view item : splitDataArgs(d.args)) {
+            uint32_t id = program.symbols.find(item);
+            if (id != SymbolTable::NONE) enter(labelAt[id]);
+        }
+    }
+    if (indirect) {
+        for (const auto &label : program.labels) enter(label.index);
+    }
+    while (!stack.empty()) {
+        uint32_t i = stack.back();
+        stack.pop_back();
+        if (flow[i].falls) enter(i + 1);
+        enter(flow[i].target);
+    }
+
+    // Writes that may be deleted if nothing reads them
+    std::vector<char> removable(n, 0);
+    for (uint32_t i = 0; i < n; i++) {
+        removable[i] = reached[i] && !inSlot[i] && fx[i].defs != 0 && !fx[i].load &&
+                       !fx[i].store && !fx[i].control && !canTrap(insts[i]);
+    }
+
+    // Predecessors of reachable instructions, for the worklist
+    std::vector<uint32_t> predStart(n + 1, 0), preds;
+    auto forEachSuccessor = [&](uint32_t i, auto &&visit) {
+        if (flow[i].falls && i + 1 < n) visit(i + 1);
+        if (flow[i].target != NONE) visit(flow[i].target);
+    };
+    for (uint32_t i = 0; i < n; i++) {
+        if (reached[i]) forEachSuccessor(i, [&](uint32_t s) { predStart[s + 1]++; });
+    }
+    for (uint32_t i = 0; i < n; i++) predStart[i + 1] += predStart[i];
+    preds.resize(predStart[n]);
+    {
+        std::vector<uint32_t> fill(predStart.begin(), predStart.end() - 1);
+        for (uint32_t i = 0; i < n; i++) {
+            if (reached[i]) forEachSuccessor(i, [&](uint32_t s) { preds[fill[s]++] = i; });
+        }
+    }
+
+    // Registers live into each instruction. A write nobody reads does not
+    // make its sources live, so whole dead chains go at once.
+    std::vector<uint32_t> liveIn(n, 0);
+    auto liveOut = [&](uint32_t i) {
+        uint32_t out = flow[i].exits ? ALL_REGISTERS : 0;
+        forEachSuccessor(i, [&](uint32_t s) { out |= liveIn[s]; });
+        return out;
+    };
+    auto isDead = [&](uint32_t i, uint32_t out) {
+        return removable[i] && (fx[i].defs & out) == 0;
+    };
+    std::vector<char> queued(n, 0);
+    stack.clear();
+    for (uint32_t i = 0; i < n; i++) {
+        if (!reached[i]) continue;
+        queued[i] = 1;
+        stack.push_back(i);
+    }
+    while (!stack.empty()) {
+        uint32_t i = stack.back();
+        stack.pop_back();
+        queued[i] = 0;
+        uint32_t out = liveOut(i);
+        uint32_t in = isDead(i, out) ? out : (out & ~fx[i].defs) | fx[i].uses;
+        if (in == liveIn[i]) continue;
+        liveIn[i] = in;
+        for (uint32_t p = predStart[i]; p < predStart[i + 1]; p++) {
+            if (!queued[preds[p]]) {
+                queued[preds[p]] = 1;
+                stack.push_back(preds[p]);
+            }
+        }
+    }
+
+    std::vector<char> keep(n, 1);
+    for (uint32_t i = 0; i < n; i++) {
+        if (!reached[i]) {
+            keep[i] = 0;
+            stats.unreachable++;
+        } else if (isDead(i, liveOut(i))) {
+            keep[i] = 0;
+            stats.deadWrites++;
+        }
+    }
+    if (stats.unreachable + stats.deadWrites == 0) return stats;
+
+    // Compact, mapping each old index to the next surviving instruction
+    std::vector<uint32_t> newIndex(n + 1);
+    uint32_t out = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        newIndex[i] = out;
+        if (keep[i]) insts[out++] = insts[i];
+    }
+    newIndex[n] = out;
+    insts.resize(out);
+
+    for (auto &label : program.labels) label.index = newIndex[label.index];
+    program.bindLabels();
+    return stats;
+}
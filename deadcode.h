@@ -0,0 +1,30 @@
+#ifndef DEADCODE_H
+#define DEADCODE_H
+
+#include "ir.h"
+#include <cstddef>
+
+struct DeadCodeStats {
+    size_t unreachable = 0;   // instructions no path from an entry reaches
+    size_t deadWrites = 0;    // ALU results overwritten before any read
+};
+
+// Dead code elimination over a lowered program (--dce). Control flow is
+// followed per instruction from the entry (address 0), every .globl label,
+// and every text label a .word names; a jr through a register other than
+// $31 makes every text label an entry. Instructions no path reaches are
+// deleted. Register liveness is then solved backwards over the same flow,
+// and a write whose register no path reads before overwriting it is
+// deleted when the instruction has no other effect: loads, stores, branches
+// and jumps, and add/sub/addi (they trap on overflow) always stay. Every
+// register counts as read at a jr, at a halt (a branch or jump to itself),
+// at a label the program does not define, and past the last instruction,
+// so the final register state is kept. With delaySlots the word after a
+// branch or jump runs before it takes effect and is never deleted. The
+// program is left as it is if any instruction is malformed (the encoder
+// reports it), a branch or jump sits in a delay slot, or a target is a
+// number rather than a label. Labels are rebound to the new addresses.
+// Code that computes instruction addresses without labels is not adjusted.
+DeadCodeStats eliminateDeadCode(Program &program, bool delaySlots);
+
+#endif
@@ -1,261 +1,341 @@
 #include "encoder.h"
 #include "error.h"
-#include <bitset>
-#include <sstream>
-#include <iomanip>
+#include "parallel.h"
+#include "perfect_hash.h"
 #include <algorithm>
+#include <string>
 
-// Instruction table: mnemonic -> definition
-static const std::map<std::string, InstructionDef> INSTRUCTIONS = {
-    {"add",    {"000000", "100000", OperandPattern::R_DST_SRC_TMP}},
-    {"addu",   {"000000", "100001", OperandPattern::R_DST_SRC_TMP}},
-    {"addi",   {"001000", "",       OperandPattern::I_TMP_SRC_IMM}},
-    {"addiu",  {"001001", "",       OperandPattern::I_TMP_SRC_IMM}},
-    {"and",    {"000000", "100100", OperandPattern::R_DST_SRC_TMP}},
-    {"andi",   {"001100", "",       OperandPattern::I_TMP_SRC_IMM}},
-    {"beq",    {"000100", "",       OperandPattern::I_SRC_TMP_LABEL}},
-    {"bne",    {"000101", "",       OperandPattern::I_SRC_TMP_LABEL}},
-    {"j",      {"000010", "",       OperandPattern::J_LABEL}},
-    {"jal",    {"000011", "",       OperandPattern::J_LABEL}},
-    {"jr",     {"000000", "001000", OperandPattern::R_SRC_ONLY}},
-    {"lbu",    {"100100", "",       OperandPattern::I_TMP_OFF_SRC}},
-    {"lhu",    {"100101", "",       OperandPattern::I_TMP_OFF_SRC}},
-    {"lui",    {"001111", "",       OperandPattern::I_TMP_IMM}},
-    {"lw",     {"100011", "",       OperandPattern::I_TMP_OFF_SRC}},
-    {"nor",    {"000000", "100111", OperandPattern::R_DST_SRC_TMP}},
-    {"or",     {"000000", "100101", OperandPattern::R_DST_SRC_TMP}},
-    {"ori",    {"001101", "",       OperandPattern::I_TMP_SRC_IMM}},
-    {"sb",     {"101000", "",       OperandPattern::I_TMP_OFF_SRC}},
-    {"sh",     {"101001", "",       OperandPattern::I_TMP_OFF_SRC}},
-    {"sll",    {"000000", "000000", OperandPattern::R_DST_TMP_SHAMT}},
-    {"slt",    {"000000", "101010", OperandPattern::R_DST_SRC_TMP}},
-    {"slti",   {"001010", "",       OperandPattern::I_TMP_SRC_IMM}},
-    {"sltiu",  {"001011", "",       OperandPattern::I_TMP_SRC_IMM}},
-    {"sltu",   {"000000", "101011", OperandPattern::R_DST_SRC_TMP}},
-    {"srl",    {"000000", "000010", OperandPattern::R_DST_TMP_SHAMT}},
-    {"sub",    {"000000", "100010", OperandPattern::R_DST_SRC_TMP}},
-    {"subu",   {"000000", "100011", OperandPattern::R_DST_SRC_TMP}},
-    {"sw",     {"101011", "",       OperandPattern::I_TMP_OFF_SRC}},
-};
+static uint32_t registerValue(const Operand &op, int lineNumber) {
+    if (op.kind == Operand::Kind::Register) return op.value;
 
-// Register number -> 5-bit binary string
-static const std::string REG_BINARY[32] = {
-    "00000","00001","00010","00011","00100","00101","00110","00111",
-    "01000","01001","01010","01011","01100","01101","01110","01111",
-    "10000","10001","10010","10011","10100","10101","10110","10111",
-    "11000","11001","11010","11011","11100","11101","11110","11111"
-};
-
-static std::string encodeRegister(const std::string &operand, int lineNumber) {
-    if (operand.size() < 2 || operand[0] != '$') {
-        reportError(lineNumber, "invalid register '" + operand + "'");
-        return "00000";
+    std::string_view text = op.text;
+    bool numeric = text.size() >= 2 && text[0] == '$' &&
+                   text.find_first_not_of("0123456789", 1) == std::string_view::npos;
+    if (numeric) {
+        reportError(lineNumber, DiagCode::BadRegister, "register number out of range: " +
+                    std::string(text));
+    } else {
+        reportError(lineNumber, DiagCode::BadRegister,
+                    "invalid register '" + std::string(text) + "'");
     }
-    int n = 0;
-    try {
-        n = std::stoi(operand.substr(1));
-    } catch (...) {
-        reportError(lineNumber, "invalid register '" + operand + "'");
-        return "00000";
+    return 0;
+}
+
+static uint32_t immediateValue(const Operand &op, int lineNumber) {
+    if (op.kind == Operand::Kind::Immediate) return op.value;
+    reportError(lineNumber, DiagCode::BadImmediate, "invalid immediate value '" +
+                std::string(op.text) + "'");
+    return 0;
+}
+
+uint32_t patchLabelField(uint32_t word, OperandPattern pattern, int target, int address) {
+    if (pattern == OperandPattern::J_LABEL) {
+        return (word & ~0x03FFFFFFu) | (static_cast<uint32_t>(target) & 0x03FFFFFFu);
     }
-    if (n < 0 || n > 31) {
-        reportError(lineNumber, "register number out of range: " + operand);
-        return "00000";
+    if (pattern == OperandPattern::I_TMP_OFF_SRC) {
+        return (word & ~0xFFFFu) | (static_cast<uint32_t>(target) & 0xFFFFu);
     }
-    return REG_BINARY[n];
+    return (word & ~0xFFFFu) |
+           (static_cast<uint32_t>(branchOffset(target, address)) & 0xFFFFu);
 }
 
-static int parseImmediate(const std::string &operand, int lineNumber) {
-    try {
-        if (operand.size() > 2 && operand[0] == '0' &&
-            (operand[1] == 'x' || operand[1] == 'X')) {
-            return static_cast<int>(std::stoul(operand.substr(2), nullptr, 16));
-        }
-        return std::stoi(operand);
-    } catch (...) {
-        reportError(lineNumber, "invalid immediate value '" + operand + "'");
-        return 0;
-    }
+bool labelInRange(OperandPattern pattern, int target, int address) {
+    if (pattern == OperandPattern::J_LABEL) return jumpTargetFits(target);
+    if (pattern == OperandPattern::I_TMP_OFF_SRC) return target >= -32768 && target <= 32767;
+    return branchOffsetFits(branchOffset(target, address));
 }
 
-static std::string encodeImmediate(int value, int bits) {
-    if (bits == 5)  return std::bitset<5>(value).to_string();
-    if (bits == 16) return std::bitset<16>(value).to_string();
-    if (bits == 26) return std::bitset<26>(value).to_string();
-    return std::string(bits, '0');
+void reportOutOfRange(OperandPattern pattern, int target, int address,
+                      int lineNumber, std::string_view label) {
+    if (pattern == OperandPattern::J_LABEL) {
+        reportError(lineNumber, DiagCode::BranchRange, "jump target '" + std::string(label) +
+                    "' is out of range");
+        return;
+    }
+    if (pattern == OperandPattern::I_TMP_OFF_SRC) {
+        reportError(lineNumber, DiagCode::AddressRange, "data label '" + std::string(label) +
+                    "' is out of range of a 16-bit offset");
+        return;
+    }
+    reportError(lineNumber, DiagCode::BranchRange, "branch to '" + std::string(label) +
+                "' is out of range (" + std::to_string(branchOffset(target, address)) + " words)");
 }
 
-static std::string bin2hex(const std::string &binary) {
-    std::bitset<32> b(binary);
-    unsigned long n = b.to_ulong();
-    std::stringstream ss;
-    ss << std::hex << std::setfill('0') << std::setw(8) << n;
-    std::string result = ss.str();
-    std::transform(result.begin(), result.end(), result.begin(), ::toupper);
-    return result;
+// Branches and jumps take word addresses, which only text labels hold;
+// load and store offsets take the byte addresses of data labels
+static bool labelFits(OperandPattern pattern, bool data) {
+    return data == (pattern == OperandPattern::I_TMP_OFF_SRC);
 }
 
-static int expectedOperandCount(OperandPattern pattern) {
-    switch (pattern) {
-        case OperandPattern::R_DST_SRC_TMP:   return 3;
-        case OperandPattern::R_DST_TMP_SHAMT:  return 3;
-        case OperandPattern::R_SRC_ONLY:        return 1;
-        case OperandPattern::I_TMP_SRC_IMM:     return 3;
-        case OperandPattern::I_TMP_IMM:         return 2;
-        case OperandPattern::I_SRC_TMP_LABEL:   return 3;
-        case OperandPattern::I_TMP_OFF_SRC:     return 3; // $t, offset, $s (lexer splits offset($s))
-        case OperandPattern::J_LABEL:           return 1;
+static void reportWrongLabel(OperandPattern pattern, int lineNumber, std::string_view label) {
+    if (pattern == OperandPattern::I_TMP_OFF_SRC) {
+        reportError(lineNumber, DiagCode::WrongSegment,
+                    "offset '" + std::string(label) + "' is not a data label");
+        return;
     }
-    return 0;
+    reportError(lineNumber, DiagCode::WrongSegment,
+                std::string(pattern == OperandPattern::J_LABEL ? "jump" : "branch") +
+                " to data label '" + std::string(label) + "'");
 }
 
-static std::string encodeInstruction(const InstructionDef &def,
-                                      const ParsedLine &line,
-                                      const std::map<std::string, int> &labels,
-                                      int address) {
-    int ln = line.lineNumber;
+// Encode one instruction at `address`, appending to `encoded`. Unknown
+// instructions and missing operands are reported and produce no word (they
+// still consume an address). A label that is not yet defined is an error,
+// unless `fixups` is given, in which case the label field is left zero and
+// a fixup is recorded for the caller to patch later.
+static void encodeInst(const Program &program, const IRInst &inst, int address,
+                       std::vector<EncodedInst> &encoded,
+                       std::vector<Fixup> *fixups) {
+    int ln = inst.lineNumber;
+    const InstructionDef *def = inst.def;
+    if (!def) {
+        std::string name(inst.mnemonic);
+        for (char &c : name) c = asciiLower(c);
+        reportError(ln, DiagCode::UnknownInstruction, "unknown instruction '" + name + "'");
+        return;
+    }
 
-    switch (def.pattern) {
-        case OperandPattern::R_DST_SRC_TMP: {
-            // add $d, $s, $t -> opcode | rs | rt | rd | 00000 | funct
-            std::string rd = encodeRegister(line.operands[0], ln);
-            std::string rs = encodeRegister(line.operands[1], ln);
-            std::string rt = encodeRegister(line.operands[2], ln);
-            return def.opcode + rs + rt + rd + "00000" + def.funct;
-        }
-        case OperandPattern::R_DST_TMP_SHAMT: {
-            // sll $d, $t, shamt -> opcode | 00000 | rt | rd | shamt | funct
-            std::string rd = encodeRegister(line.operands[0], ln);
-            std::string rt = encodeRegister(line.operands[1], ln);
-            std::string shamt = encodeImmediate(
-                parseImmediate(line.operands[2], ln), 5);
-            return def.opcode + "00000" + rt + rd + shamt + def.funct;
-        }
-        case OperandPattern::R_SRC_ONLY: {
-            // jr $s -> opcode | rs | 000000000000000 | funct
-            std::string rs = encodeRegister(line.operands[0], ln);
-            return def.opcode + rs + "000000000000000" + def.funct;
-        }
-        case OperandPattern::I_TMP_SRC_IMM: {
-            // addi $t, $s, imm -> opcode | rs | rt | imm
-            std::string rt = encodeRegister(line.operands[0], ln);
-            std::string rs = encodeRegister(line.operands[1], ln);
-            std::string imm = encodeImmediate(
-                parseImmediate(line.operands[2], ln), 16);
-            return def.opcode + rs + rt + imm;
-        }
-        case OperandPattern::I_TMP_IMM: {
-            // lui $t, imm -> opcode | 00000 | rt | imm
-            std::string rt = encodeRegister(line.operands[0], ln);
-            std::string imm = encodeImmediate(
-                parseImmediate(line.operands[1], ln), 16);
-            return def.opcode + "00000" + rt + imm;
-        }
-        case OperandPattern::I_SRC_TMP_LABEL: {
-            // beq $s, $t, label -> opcode | rs | rt | offset
-            std::string rs = encodeRegister(line.operands[0], ln);
-            std::string rt = encodeRegister(line.operands[1], ln);
-            const std::string &labelName = line.operands[2];
-            auto it = labels.find(labelName);
-            if (it == labels.end()) {
-                reportError(ln, "undefined label '" + labelName + "'");
-                return std::string(32, '0');
-            }
-            int target = it->second;
-            int offset;
-            // Replicate original asymmetric formula:
-            // Forward:  offset = (target - current) - 1
-            // Backward: offset = -(current - target)
-            if (target > address) {
-                offset = (target - address) - 1;
-            } else {
-                offset = -(address - target);
-            }
-            std::string imm = encodeImmediate(offset, 16);
-            return def.opcode + rs + rt + imm;
-        }
-        case OperandPattern::I_TMP_OFF_SRC: {
-            // lw $t, offset($s) -> opcode | rs | rt | offset
-            // Lexer splits "offset($s)" into two operands: [offset, $s]
-            std::string rt = encodeRegister(line.operands[0], ln);
-            std::string imm = encodeImmediate(
-                parseImmediate(line.operands[1], ln), 16);
-            std::string rs = encodeRegister(line.operands[2], ln);
-            return def.opcode + rs + rt + imm;
-        }
-        case OperandPattern::J_LABEL: {
-            // j label -> opcode | address
-            const std::string &labelName = line.operands[0];
-            auto it = labels.find(labelName);
-            if (it == labels.end()) {
-                reportError(ln, "undefined label '" + labelName + "'");
-                return std::string(32, '0');
+    // Check operand count
+    int expected = expectedOperandCount(def->pattern);
+    if (!inst.lowered()) {
+        reportError(ln, DiagCode::OperandCount, "'" + std::string(def->mnemonic) + "' requires " +
+                    std::to_string(expected) + " operands, got " +
+                    std::to_string(inst.numOperands));
+        return;
+    }
+
+    // Resolve operands in source order so diagnostics follow the text
+    const Operand *ops = program.operandsOf(inst);
+    uint32_t values[3] = {0, 0, 0};
+    bool undefined = false;
+    for (int i = 0; i < expected; i++) {
+        const Operand &op = ops[i];
+        switch (op.kind) {
+            case Operand::Kind::Register:
+            case Operand::Kind::BadRegister:
+                values[i] = registerValue(op, ln);
+                break;
+            case Operand::Kind::Immediate:
+            case Operand::Kind::BadImmediate:
+                values[i] = immediateValue(op, ln);
+                break;
+            case Operand::Kind::Symbol: {
+                if (!program.symbols.isDefined(op.value)) {
+                    if (fixups) {
+                        fixups->push_back({encoded.size(), address, ln, def->pattern, op.value});
+                    } else {
+                        reportError(ln, DiagCode::UndefinedLabel, "undefined label '" +
+                                    std::string(op.text) + "'");
+                        undefined = true;
+                    }
+                    break;
+                }
+                if (!labelFits(def->pattern, program.symbols.isData(op.value))) {
+                    reportWrongLabel(def->pattern, ln, op.text);
+                    undefined = true;
+                    break;
+                }
+                int target = program.symbols.address(op.value);
+                if (!labelInRange(def->pattern, target, address)) {
+                    reportOutOfRange(def->pattern, target, address, ln, op.text);
+                }
+                values[i] = def->pattern == OperandPattern::I_SRC_TMP_LABEL
+                                ? static_cast<uint32_t>(branchOffset(target, address))
+                                : static_cast<uint32_t>(target);
+                break;
             }
-            std::string addr = encodeImmediate(it->second, 26);
-            return def.opcode + addr;
         }
     }
-    return std::string(32, '0');
+
+    EncodedInst out;
+    out.word = undefined ? 0 : packInstruction(*def, values[0], values[1], values[2]);
+    out.rawText = inst.rawText;
+    encoded.push_back(out);
 }
 
-std::map<std::string, int> buildLabelTable(const std::vector<ParsedLine> &lines) {
-    std::map<std::string, int> labels;
-    int address = 0;
+std::vector<EncodedInst> encode(const Program &program, unsigned jobs,
+                                std::vector<Fixup> *unresolved) {
+    // Below this many instructions per worker, thread startup costs more
+    // than it saves
+    const size_t MIN_INSTS_PER_CHUNK = 16384;
+    const auto &insts = program.insts;
+
+    size_t numChunks = 1;
+    if (jobs > 1) {
+        numChunks = std::min<size_t>(static_cast<size_t>(jobs) * 4,
+                                     insts.size() / MIN_INSTS_PER_CHUNK);
+        if (numChunks < 2) numChunks = 1;
+    }
 
-    for (const auto &line : lines) {
-        if (!line.label.empty()) {
-            if (labels.count(line.label)) {
-                reportError(line.lineNumber,
-                            "duplicate label '" + line.label + "'");
+    if (numChunks == 1) {
+        std::vector<EncodedInst> encoded;
+        encoded.reserve(insts.size());
+        for (size_t i = 0; i < insts.size() && !errorLimitReached(); i++) {
+            encodeInst(program, insts[i], static_cast<int>(i), encoded, unresolved);
+        }
+        return encoded;
+    }
+
+    // Instruction i is at address i and the program is read-only from here
+    // on, so chunks are independent.
+    size_t chunkSize = (insts.size() + numChunks - 1) / numChunks;
+    std::vector<std::vector<EncodedInst>> chunkOut(numChunks);
+    std::vector<std::vector<Fixup>> chunkFixups(unresolved ? numChunks : 0);
+    std::vector<ErrorContext> chunkErrors(numChunks, ErrorContext(true));
+    // Each chunk stops at the caller's error limit; replay applies it overall
+    DiagnosticOptions chunkOptions;
+    chunkOptions.maxErrors = currentErrorContext().options().maxErrors;
+    for (auto &errors : chunkErrors) errors.setOptions(chunkOptions);
+
+    parallelFor(numChunks, jobs, [&](size_t c) {
+        ErrorScope scope(chunkErrors[c]);
+        size_t begin = c * chunkSize;
+        size_t end = std::min(insts.size(), begin + chunkSize);
+        auto &out = chunkOut[c];
+        out.reserve(end - begin);
+        for (size_t i = begin; i < end && !errorLimitReached(); i++) {
+            encodeInst(program, insts[i], static_cast<int>(i), out,
+                       unresolved ? &chunkFixups[c] : nullptr);
+        }
+    });
+
+    // Merge in chunk order so output and diagnostics stay in line order
+    std::vector<EncodedInst> encoded;
+    encoded.reserve(insts.size());
+    ErrorContext &errors = currentErrorContext();
+    for (size_t c = 0; c < numChunks; c++) {
+        if (unresolved) {
+            // Fixup positions are within the chunk's output
+            for (Fixup f : chunkFixups[c]) {
+                f.index += encoded.size();
+                unresolved->push_back(f);
             }
-            labels[line.label] = address;
         }
-        if (!line.mnemonic.empty()) {
-            address++;
+        encoded.insert(encoded.end(), chunkOut[c].begin(), chunkOut[c].end());
+        chunkErrors[c].replay(errors);
+    }
+
+    return encoded;
+}
+
+// Patch every earlier reference to a label that was just defined
+void StreamEncoder::resolve(uint32_t id) {
+    if (id >= pendingHead_.size()) return;
+    int target = scratch_.symbols.address(id);
+    bool data = scratch_.symbols.isData(id);
+    uint32_t p = pendingHead_[id];
+    std::vector<Fixup> bad;   // out of range, or the wrong kind of label
+    while (p != NONE) {
+        PendingFixup &entry = pending_[p];
+        const Fixup &f = entry.fixup;
+        uint32_t &word = encoded_[f.index].word;
+        if (!labelFits(f.pattern, data)) {
+            bad.push_back(f);
+        } else {
+            if (!labelInRange(f.pattern, target, f.address)) bad.push_back(f);
+            word = patchLabelField(word, f.pattern, target, f.address);
         }
+        uint32_t next = entry.next;
+        entry.next = freeHead_;
+        freeHead_ = p;
+        pendingCount_--;
+        p = next;
     }
+    pendingHead_[id] = NONE;
 
-    return labels;
+    // The chain is newest first; report in line order
+    for (auto f = bad.rbegin(); f != bad.rend(); ++f) {
+        if (!labelFits(f->pattern, data)) {
+            reportWrongLabel(f->pattern, f->lineNumber, scratch_.symbols.name(id));
+        } else {
+            reportOutOfRange(f->pattern, target, f->address, f->lineNumber,
+                             scratch_.symbols.name(id));
+        }
+    }
 }
 
-std::vector<EncodedInst> encode(const std::vector<ParsedLine> &lines,
-                                 const std::map<std::string, int> &labels) {
-    std::vector<EncodedInst> encoded;
-    int address = 0;
+void StreamEncoder::add(const ParsedLine &line) {
+    SymbolTable &symbols = scratch_.symbols;
 
-    for (const auto &line : lines) {
-        if (line.mnemonic.empty()) continue; // skip label-only lines
+    bool directive = isDirective(line.mnemonic);
+    if (directive) {
+        lowerDirective(scratch_, line, inData_);
+    } else if (inData_ && !line.label.empty()) {
+        scratch_.dataLabels.push_back({symbols.intern(line.label),
+                                       static_cast<uint32_t>(scratch_.data.size()),
+                                       line.lineNumber});
+    }
 
-        auto it = INSTRUCTIONS.find(line.mnemonic);
-        if (it == INSTRUCTIONS.end()) {
-            reportError(line.lineNumber,
-                        "unknown instruction '" + line.mnemonic + "'");
-            address++;
-            continue;
+    if (!line.label.empty() && !inData_) {
+        uint32_t id = symbols.intern(line.label);
+        if (symbols.isDefined(id)) {
+            reportError(line.lineNumber, DiagCode::DuplicateLabel, "duplicate label '" +
+                        std::string(line.label) + "'");
         }
+        symbols.define(id, address_);
+        resolve(id);
+    }
 
-        const auto &def = it->second;
+    if (directive || line.mnemonic.empty()) return;
+    if (inData_) {
+        reportError(line.lineNumber, DiagCode::WrongSegment, "instruction in .data");
+        return;
+    }
 
-        // Check operand count
-        int expected = expectedOperandCount(def.pattern);
-        if (static_cast<int>(line.operands.size()) < expected) {
-            reportError(line.lineNumber,
-                        "'" + line.mnemonic + "' requires " +
-                        std::to_string(expected) + " operands, got " +
-                        std::to_string(line.operands.size()));
-            address++;
-            continue;
-        }
+    scratch_.insts.clear();
+    scratch_.operands.clear();
+    lowerInstruction(scratch_, line);
 
-        std::string binary = encodeInstruction(def, line, labels, address);
+    fixups_.clear();
+    encodeInst(scratch_, scratch_.insts[0], address_, encoded_, &fixups_);
+    for (const Fixup &f : fixups_) {
+        if (pendingHead_.size() < symbols.size()) pendingHead_.resize(symbols.size(), NONE);
+        uint32_t slot;
+        if (freeHead_ != NONE) {
+            slot = freeHead_;
+            freeHead_ = pending_[slot].next;
+            pending_[slot] = {f, pendingHead_[f.symbol]};
+        } else {
+            slot = static_cast<uint32_t>(pending_.size());
+            pending_.push_back({f, pendingHead_[f.symbol]});
+        }
+        pendingHead_[f.symbol] = slot;
+        pendingCount_++;
+    }
+    address_++;
+}
 
-        EncodedInst inst;
-        inst.hex = bin2hex(binary);
-        inst.rawText = line.rawText;
-        encoded.push_back(inst);
+std::vector<EncodedInst> StreamEncoder::finish(DataImage *data) {
+    // The data segment follows the text, so it is placed only now
+    DataImage discarded;
+    layoutData(scratch_.data, scratch_.dataLabels, static_cast<uint32_t>(address_),
+               scratch_.symbols, data ? *data : discarded);
+    for (const auto &label : scratch_.dataLabels) {
+        if (scratch_.symbols.isDefined(label.symbol)) resolve(label.symbol);
+    }
 
-        address++;
+    // Anything still pending refers to a label that was never defined.
+    // Report in line order, as the multi-pass encoder would.
+    std::vector<Fixup> unresolved;
+    unresolved.reserve(pendingCount_);
+    for (uint32_t head : pendingHead_) {
+        for (uint32_t p = head; p != NONE; p = pending_[p].next) {
+            unresolved.push_back(pending_[p].fixup);
+        }
+    }
+    std::sort(unresolved.begin(), unresolved.end(),
+              [](const Fixup &a, const Fixup &b) { return a.index < b.index; });
+    for (const Fixup &f : unresolved) {
+        reportError(f.lineNumber, DiagCode::UndefinedLabel, "undefined label '" +
+                    std::string(scratch_.symbols.name(f.symbol)) + "'");
     }
 
-    return encoded;
+    pending_.clear();
+    pendingHead_.clear();
+    freeHead_ = NONE;
+    pendingCount_ = 0;
+    scratch_.data.clear();
+    scratch_.dataLabels.clear();
+    inData_ = false;
+    return std::move(encoded_);
 }
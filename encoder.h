@@ -1,35 +1,86 @@
 #ifndef ENCODER_H
 #define ENCODER_H
 
+#include "ir.h"
+#include "isa.h"
 #include "lexer.h"
-#include <string>
+#include <cstdint>
+#include <string_view>
 #include <vector>
-#include <map>
-
-enum class OperandPattern {
-    R_DST_SRC_TMP,    // add $d, $s, $t
-    R_DST_TMP_SHAMT,  // sll $d, $t, shamt
-    R_SRC_ONLY,        // jr $s
-    I_TMP_SRC_IMM,     // addi $t, $s, imm
-    I_TMP_IMM,         // lui $t, imm
-    I_SRC_TMP_LABEL,   // beq $s, $t, label
-    I_TMP_OFF_SRC,     // lw $t, offset($s)
-    J_LABEL,           // j label / jal label
-};
 
-struct InstructionDef {
-    std::string opcode;    // 6-bit binary string
-    std::string funct;     // 6-bit for R-type, empty otherwise
-    OperandPattern pattern;
+struct EncodedInst {
+    uint32_t word;        // packed 32-bit machine word
+    std::string_view rawText;  // original source line for MIF comment
 };
 
-struct EncodedInst {
-    std::string hex;      // 8-char uppercase hex
-    std::string rawText;  // original source line for MIF comment
+// A label reference that was not yet defined when its instruction was
+// encoded. The label field is patched once the address is known.
+struct Fixup {
+    size_t index;            // position of the instruction in the output
+    int address;             // address of the referencing instruction
+    int lineNumber;
+    OperandPattern pattern;  // I_SRC_TMP_LABEL, J_LABEL or I_TMP_OFF_SRC
+    uint32_t symbol;
 };
 
-std::map<std::string, int> buildLabelTable(const std::vector<ParsedLine> &lines);
-std::vector<EncodedInst> encode(const std::vector<ParsedLine> &lines,
-                                 const std::map<std::string, int> &labels);
+// Encode every instruction against the program's bound labels. With
+// jobs > 1, large programs are split into chunks encoded on that many
+// threads; output and diagnostics are identical to the sequential run.
+// Labels that are not defined are errors, unless `unresolved` is given:
+// then their field is left zero and a fixup is recorded there, in order.
+std::vector<EncodedInst> encode(const Program &program, unsigned jobs = 1,
+                                std::vector<Fixup> *unresolved = nullptr);
+
+// Fill in the label field of an already-encoded branch or jump at
+// `address` with `target`, or the offset of a load or store with the
+// byte address of a data label.
+uint32_t patchLabelField(uint32_t word, OperandPattern pattern, int target, int address);
+
+// Whether the branch or jump at `address` can reach `target`, or a data
+// address fits a 16-bit offset
+bool labelInRange(OperandPattern pattern, int target, int address);
+
+// "branch to 'L' is out of range (N words)", "jump target 'L' is out of
+// range" or "data label 'L' is out of range of a 16-bit offset"
+void reportOutOfRange(OperandPattern pattern, int target, int address,
+                      int lineNumber, std::string_view label);
+
+// Single-pass encoder. Lines are fed in source order (aliases resolved and
+// pseudos expanded); each instruction is encoded immediately, and forward
+// references are patched as soon as their label is defined. Memory is the
+// output words, the symbol table and the fixups still pending.
+class StreamEncoder {
+public:
+    void add(const ParsedLine &line);
+
+    // Lay out the .data segment into `data` (if given), report labels
+    // that were never defined, and hand over the output.
+    std::vector<EncodedInst> finish(DataImage *data = nullptr);
+
+    size_t pendingFixups() const { return pendingCount_; }
+    size_t labelCount() const { return scratch_.symbols.definedCount(); }
+    const SymbolTable &symbols() const { return scratch_.symbols; }
+
+private:
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    void resolve(uint32_t id);
+
+    struct PendingFixup {
+        Fixup fixup;
+        uint32_t next;       // next pending fixup for the same symbol
+    };
+
+    // Holds the symbol table; insts/operands are reused for each line
+    Program scratch_;
+    std::vector<Fixup> fixups_;
+    std::vector<PendingFixup> pending_;
+    std::vector<uint32_t> pendingHead_;   // per symbol ID
+    uint32_t freeHead_ = NONE;
+    size_t pendingCount_ = 0;
+    std::vector<EncodedInst> encoded_;
+    int address_ = 0;
+    bool inData_ = false;
+};
 
 #endif
@@ -1,31 +1,388 @@
 #include "error.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
 #include <iostream>
+#include <mutex>
 
-static int g_errorCount = 0;
+static thread_local ErrorContext t_defaultContext;
+static thread_local ErrorContext *t_current = &t_defaultContext;
 
-void reportError(int line, const std::string &msg) {
-    if (line > 0)
-        std::cerr << "Error on line " << line << ": " << msg << std::endl;
-    else
-        std::cerr << "Error: " << msg << std::endl;
-    g_errorCount++;
+// Pending text is written once it reaches this size
+static const size_t FLUSH_THRESHOLD = 64 * 1024;
+
+// Line numbers listed in a repeat summary
+static const size_t MAX_REPEAT_LINES = 8;
+
+const char *codeName(DiagCode code, Severity severity) {
+    switch (code) {
+        case DiagCode::Other:              break;
+        case DiagCode::UnknownInstruction: return "unknown-instruction";
+        case DiagCode::BadRegister:        return "bad-register";
+        case DiagCode::BadImmediate:       return "bad-immediate";
+        case DiagCode::OperandCount:       return "operand-count";
+        case DiagCode::UndefinedLabel:     return "undefined-label";
+        case DiagCode::DuplicateLabel:     return "duplicate-label";
+        case DiagCode::UnknownDirective:   return "unknown-directive";
+        case DiagCode::WrongSegment:       return "wrong-segment";
+        case DiagCode::BadDirective:       return "bad-directive";
+        case DiagCode::BadOption:          return "bad-option";
+        case DiagCode::Overlap:            return "overlap";
+        case DiagCode::AddressRange:       return "address-range";
+        case DiagCode::BranchRange:        return "branch-range";
+        case DiagCode::ImageTooLarge:      return "image-too-large";
+        case DiagCode::BadObject:          return "bad-object";
+        case DiagCode::BadProfile:         return "bad-profile";
+        case DiagCode::Io:                 return "io";
+        case DiagCode::ErrorLimit:         return "error-limit";
+    }
+    return severity == Severity::Warning ? "warning" : "error";
+}
+
+namespace {
+
+// Printed text not yet written. Lines for one stream accumulate until the
+// other stream is used, so stdout and stderr keep their relative order.
+struct PendingOutput {
+    std::mutex mutex;
+    std::string text;
+    int fd = STDERR_FILENO;
+
+    void writeOut() {
+        if (text.empty()) return;
+        // Anything printed through iostreams goes first
+        std::cout.flush();
+        const char *p = text.data();
+        size_t left = text.size();
+        while (left > 0) {
+            ssize_t n = ::write(fd, p, left);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            p += n;
+            left -= static_cast<size_t>(n);
+        }
+        text.clear();
+    }
+
+    void append(int stream, const std::string &line) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (stream != fd) {
+            writeOut();
+            fd = stream;
+        }
+        text += line;
+        if (text.size() >= FLUSH_THRESHOLD) writeOut();
+    }
+};
+
+struct JsonRecord {
+    std::string file;
+    Diagnostic diagnostic;
+};
+
+struct JsonCollector {
+    std::mutex mutex;
+    bool enabled = false;
+    std::vector<JsonRecord> records;
+};
+
+// Never destroyed, so diagnostics printed during exit are still written
+PendingOutput &pendingOutput() {
+    static PendingOutput *p = [] {
+        std::atexit(flushDiagnostics);
+        return new PendingOutput;
+    }();
+    return *p;
+}
+
+JsonCollector &jsonCollector() {
+    static JsonCollector *c = new JsonCollector;
+    return *c;
+}
+
+} // namespace
+
+void ErrorContext::setSource(std::string_view text, const std::string &name) {
+    source_ = text;
+    sourceName_ = name;
+    lineStarts_.clear();
+}
+
+// Column of the first quoted token of `msg` on the line, or of the line's
+// first non-blank character
+int ErrorContext::columnOf(int line, const std::string &msg) {
+    if (line <= 0 || source_.empty()) return 0;
+    if (lineStarts_.empty()) {
+        lineStarts_.push_back(0);
+        for (size_t i = 0; i < source_.size(); i++) {
+            if (source_[i] == '\n') lineStarts_.push_back(i + 1);
+        }
+    }
+    if (static_cast<size_t>(line) > lineStarts_.size()) return 0;
+    size_t start = lineStarts_[line - 1];
+    size_t end = source_.find('\n', start);
+    std::string_view text = source_.substr(start, end == std::string_view::npos
+                                                      ? std::string_view::npos
+                                                      : end - start);
+
+    size_t open = msg.find('\'');
+    size_t close = open == std::string::npos ? open : msg.find('\'', open + 1);
+    if (close != std::string::npos && close > open + 1) {
+        size_t at = text.find(std::string_view(msg).substr(open + 1, close - open - 1));
+        if (at != std::string_view::npos) return static_cast<int>(at) + 1;
+    }
+    size_t first = text.find_first_not_of(" \t");
+    return first == std::string_view::npos ? 0 : static_cast<int>(first) + 1;
+}
+
+// `record` is false for lines that summarize diagnostics already recorded
+void ErrorContext::print(const Diagnostic &d, bool record) const {
+    if (d.severity == Severity::Info) {
+        pendingOutput().append(STDOUT_FILENO, d.message + "\n");
+        return;
+    }
+
+    JsonCollector &json = jsonCollector();
+    if (record && json.enabled) {
+        std::lock_guard<std::mutex> lock(json.mutex);
+        json.records.push_back({sourceName_.empty() ? file_ : sourceName_, d});
+    }
+    if (d.repeat) return;
+
+    const char *kind = d.severity == Severity::Error ? "Error" : "Warning";
+    std::string line;
+    if (!file_.empty()) line = file_ + ": ";
+    line += kind;
+    if (d.line > 0) line += " on line " + std::to_string(d.line);
+    line += ": " + d.message + "\n";
+    pendingOutput().append(STDERR_FILENO, line);
+}
+
+void ErrorContext::keep(Diagnostic d) {
+    if (buffered_) {
+        diagnostics_.push_back(std::move(d));
+    } else {
+        print(d);
+    }
+}
+
+void ErrorContext::report(int line, Severity severity, DiagCode code, const std::string &msg) {
+    if (severity == Severity::Error) {
+        // Past the limit, errors are only counted
+        if (limitReached()) {
+            errorCount_++;
+            return;
+        }
+        errorCount_++;
+    }
+
+    Diagnostic d{line, severity, msg};
+    if (severity != Severity::Info) {
+        d.code = code;
+        d.column = columnOf(line, msg);
+    }
+    if (options_.dedup && severity != Severity::Info) {
+        std::string key = (severity == Severity::Error ? "E" : "W") + msg;
+        auto it = seen_.find(key);
+        if (it != seen_.end()) {
+            Repeat &r = repeats_[it->second];
+            r.more++;
+            if (line > 0 && r.lines.size() < MAX_REPEAT_LINES) r.lines.push_back(line);
+            d.repeat = true;
+        } else {
+            seen_.emplace(std::move(key), repeats_.size());
+            repeats_.push_back({d, 0, {}});
+        }
+    }
+    keep(std::move(d));
+
+    if (severity == Severity::Error && limitReached()) {
+        Diagnostic stop{0, Severity::Error,
+                        "too many errors, stopping after " + std::to_string(errorCount_)};
+        stop.code = DiagCode::ErrorLimit;
+        keep(std::move(stop));
+    }
+}
+
+void ErrorContext::replay(ErrorContext &target) const {
+    for (const auto &d : diagnostics_) {
+        // The limit note is the target's to add
+        if (d.code == DiagCode::ErrorLimit) continue;
+        target.report(d.line, d.severity, d.code, d.message);
+    }
 }
 
-void reportWarning(int line, const std::string &msg) {
-    if (line > 0)
-        std::cerr << "Warning on line " << line << ": " << msg << std::endl;
-    else
-        std::cerr << "Warning: " << msg << std::endl;
+// The first occurrence of a message, noting how often and where it repeated
+Diagnostic ErrorContext::summaryOf(const Repeat &r) {
+    Diagnostic d = r.first;
+    d.message += " (repeated " + std::to_string(r.more) + " more time" +
+                 (r.more == 1 ? "" : "s");
+    for (size_t i = 0; i < r.lines.size(); i++) {
+        d.message += (i == 0 ? (r.lines.size() == 1 ? ", on line " : ", on lines ") : ", ") +
+                     std::to_string(r.lines[i]);
+    }
+    if (r.lines.size() < r.more && !r.lines.empty()) d.message += ", ...";
+    d.message += ")";
+    return d;
+}
+
+void ErrorContext::flush() {
+    for (const auto &d : diagnostics_) {
+        print(d);
+    }
+    diagnostics_.clear();
+
+    for (auto &r : repeats_) {
+        if (r.more == 0) continue;
+        print(summaryOf(r), false);
+        r.more = 0;
+        r.lines.clear();
+    }
+}
+
+std::vector<Diagnostic> ErrorContext::printed() const {
+    std::vector<Diagnostic> out;
+    for (const auto &d : diagnostics_) {
+        if (!d.repeat) out.push_back(d);
+    }
+    for (const auto &r : repeats_) {
+        if (r.more > 0) out.push_back(summaryOf(r));
+    }
+    return out;
+}
+
+void ErrorContext::reset() {
+    errorCount_ = 0;
+    diagnostics_.clear();
+    seen_.clear();
+    repeats_.clear();
+}
+
+ErrorScope::ErrorScope(ErrorContext &ctx) : previous_(t_current) {
+    t_current = &ctx;
+}
+
+ErrorScope::~ErrorScope() {
+    t_current = previous_;
+}
+
+ErrorContext &currentErrorContext() {
+    return *t_current;
+}
+
+void reportError(int line, DiagCode code, const std::string &msg) {
+    t_current->report(line, Severity::Error, code, msg);
+}
+
+void reportWarning(int line, DiagCode code, const std::string &msg) {
+    t_current->report(line, Severity::Warning, code, msg);
+}
+
+void reportInfo(const std::string &msg) {
+    t_current->report(0, Severity::Info, DiagCode::Other, msg);
 }
 
 bool hasErrors() {
-    return g_errorCount > 0;
+    return t_current->errorCount() > 0;
 }
 
 int errorCount() {
-    return g_errorCount;
+    return t_current->errorCount();
 }
 
 void resetErrors() {
-    g_errorCount = 0;
+    t_current->reset();
+}
+
+bool errorLimitReached() {
+    return t_current->limitReached();
+}
+
+void flushDiagnostics() {
+    PendingOutput &out = pendingOutput();
+    std::lock_guard<std::mutex> lock(out.mutex);
+    out.writeOut();
+}
+
+void collectDiagnosticsJson() {
+    JsonCollector &json = jsonCollector();
+    std::lock_guard<std::mutex> lock(json.mutex);
+    json.enabled = true;
+}
+
+static void appendJsonString(std::string &out, std::string_view s) {
+    out += '"';
+    for (char c : s) {
+        switch (c) {
+            case '"':  out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\t': out += "\\t"; break;
+            case '\r': out += "\\r"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char buf[8];
+                    std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+                    out += buf;
+                } else {
+                    out += c;
+                }
+        }
+    }
+    out += '"';
+}
+
+bool writeDiagnosticsJson(const std::string &path) {
+    JsonCollector &json = jsonCollector();
+    std::string out;
+    size_t errors = 0, warnings = 0;
+    {
+        std::lock_guard<std::mutex> lock(json.mutex);
+        out.reserve(64 + json.records.size() * 128);
+        out += "{\"diagnostics\":[";
+        for (size_t i = 0; i < json.records.size(); i++) {
+            const JsonRecord &r = json.records[i];
+            const Diagnostic &d = r.diagnostic;
+            bool error = d.severity == Severity::Error;
+            (error ? errors : warnings)++;
+            out += i ? ",\n" : "\n";
+            out += "{\"file\":";
+            appendJsonString(out, r.file);
+            out += ",\"line\":" + std::to_string(d.line) +
+                   ",\"column\":" + std::to_string(d.column) + ",\"severity\":";
+            out += error ? "\"error\"" : "\"warning\"";
+            out += ",\"code\":";
+            appendJsonString(out, codeName(d.code, d.severity));
+            out += ",\"message\":";
+            appendJsonString(out, d.message);
+            out += '}';
+        }
+    }
+    out += "\n],\"errors\":" + std::to_string(errors) +
+           ",\"warnings\":" + std::to_string(warnings) + "}\n";
+
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        reportError(0, DiagCode::Io, "cannot open diagnostics file '" + path + "'");
+        return false;
+    }
+    const char *p = out.data();
+    size_t left = out.size();
+    bool ok = true;
+    while (left > 0) {
+        ssize_t n = ::write(fd, p, left);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            ok = false;
+            break;
+        }
+        p += n;
+        left -= static_cast<size_t>(n);
+    }
+    ok &= ::close(fd) == 0;
+    if (!ok) reportError(0, DiagCode::Io, "failed writing diagnostics file '" + path + "'");
+    return ok;
 }
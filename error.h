@@ -1,12 +1,175 @@
 #ifndef ERROR_H
 #define ERROR_H
 
+#include <cstddef>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
 
-void reportError(int line, const std::string &msg);
-void reportWarning(int line, const std::string &msg);
+enum class Severity {
+    Error,
+    Warning,
+    Info,     // progress/summary messages, printed to std::cout
+};
+
+// Class of an error or warning, given by the code that reports it. JSON
+// output names it with a stable kebab-case code (see codeName()).
+enum class DiagCode {
+    Other,                // "error" or "warning", by severity
+    UnknownInstruction,   // "unknown-instruction"
+    BadRegister,          // "bad-register"
+    BadImmediate,         // "bad-immediate"
+    OperandCount,         // "operand-count"
+    UndefinedLabel,       // "undefined-label"
+    DuplicateLabel,       // "duplicate-label"
+    UnknownDirective,     // "unknown-directive"
+    WrongSegment,         // "wrong-segment"
+    BadDirective,         // "bad-directive"
+    BadOption,            // "bad-option"
+    Overlap,              // "overlap"
+    AddressRange,         // "address-range"
+    BranchRange,          // "branch-range"
+    ImageTooLarge,        // "image-too-large"
+    BadObject,            // "bad-object"
+    BadProfile,           // "bad-profile"
+    Io,                   // "io"
+    ErrorLimit,           // "error-limit"
+};
+
+const char *codeName(DiagCode code, Severity severity);
+
+struct Diagnostic {
+    int line;             // source line, or 0 if not tied to a line
+    Severity severity;
+    std::string message;
+    int column = 0;       // 1-based, or 0 if unknown
+    DiagCode code = DiagCode::Other;
+    bool repeat = false;     // left out of printed output by dedup; still
+                             //   counted, listed and written as JSON
+};
+
+// How a context treats what is reported to it.
+struct DiagnosticOptions {
+    // Stop keeping errors after this many (0 = no limit). Reaching the
+    // limit adds one "too many errors" error, and errorLimitReached()
+    // tells the pipeline to stop early.
+    unsigned maxErrors = 0;
+
+    // Print only the first of several identical messages; the rest are
+    // summarized by flush() with their line numbers. Every occurrence is
+    // still counted, kept in diagnostics() and written as JSON.
+    bool dedup = false;
+};
+
+// Diagnostics for one unit of work. reportError/reportWarning and the
+// queries below act on the context installed on the calling thread (see
+// ErrorScope); each thread starts with its own unbuffered context, so no
+// state is shared between threads.
+//
+// An unbuffered context prints each diagnostic as it arrives. A buffered
+// one keeps them until replay() or flush(), which lets worker threads
+// collect diagnostics privately and have them emitted in a fixed order.
+// Either way, printed text is batched (see flushDiagnostics()).
+class ErrorContext {
+public:
+    explicit ErrorContext(bool buffered = false) : buffered_(buffered) {}
+
+    // Prefix printed errors and warnings with "<file>: "
+    void setFile(const std::string &file) { file_ = file; }
+    const std::string &file() const { return file_; }
+
+    void setOptions(const DiagnosticOptions &options) { options_ = options; }
+    const DiagnosticOptions &options() const { return options_; }
+
+    // Source text that line numbers refer to, used to find columns, and
+    // its name for JSON output. The text must outlive the reports made
+    // while it is set; clear it with an empty view.
+    void setSource(std::string_view text, const std::string &name);
+
+    void report(int line, Severity severity, DiagCode code, const std::string &msg);
+
+    int errorCount() const { return errorCount_; }
+    bool limitReached() const {
+        return options_.maxErrors > 0 && errorCount_ >= static_cast<int>(options_.maxErrors);
+    }
+    const std::vector<Diagnostic> &diagnostics() const { return diagnostics_; }
+
+    // Re-report every buffered diagnostic into `target`, in arrival order.
+    void replay(ErrorContext &target) const;
+
+    // Print and discard every buffered diagnostic, then one summary line
+    // per deduplicated message.
+    void flush();
+
+    // What flush() would print: the buffered diagnostics without the
+    // repeats that dedup leaves out, then the summary lines
+    std::vector<Diagnostic> printed() const;
+
+    void reset();
+
+private:
+    void keep(Diagnostic d);
+    void print(const Diagnostic &d, bool record = true) const;
+    struct Repeat;
+    static Diagnostic summaryOf(const Repeat &r);
+    int columnOf(int line, const std::string &msg);
+
+    bool buffered_;
+    DiagnosticOptions options_;
+    int errorCount_ = 0;
+    std::string file_;
+    std::string sourceName_;
+    std::string_view source_;
+    std::vector<size_t> lineStarts_;   // built on first use
+    std::vector<Diagnostic> diagnostics_;
+
+    // Deduplication: each distinct message, first occurrence first
+    struct Repeat {
+        Diagnostic first;
+        size_t more;
+        std::vector<int> lines;   // of the repeats, up to MAX_REPEAT_LINES
+    };
+    std::unordered_map<std::string, size_t> seen_;   // message -> repeats_ index
+    std::vector<Repeat> repeats_;
+};
+
+// Installs a context on the current thread for the lifetime of the scope.
+class ErrorScope {
+public:
+    explicit ErrorScope(ErrorContext &ctx);
+    ~ErrorScope();
+
+    ErrorScope(const ErrorScope &) = delete;
+    ErrorScope &operator=(const ErrorScope &) = delete;
+
+private:
+    ErrorContext *previous_;
+};
+
+ErrorContext &currentErrorContext();
+
+void reportError(int line, DiagCode code, const std::string &msg);
+void reportWarning(int line, DiagCode code, const std::string &msg);
+void reportInfo(const std::string &msg);
 bool hasErrors();
 int errorCount();
 void resetErrors();
 
+// True once the current context holds --max-errors errors. Long-running
+// stages poll this to stop early.
+bool errorLimitReached();
+
+// Printed diagnostics are collected in one process-wide buffer and written
+// in large blocks (stdout and stderr lines keep their relative order).
+// Write out whatever is pending; also done at exit.
+void flushDiagnostics();
+
+// Also collect every printed error and warning (file, line, column, code,
+// severity, message) for writeDiagnosticsJson().
+void collectDiagnosticsJson();
+
+// Write the collected diagnostics as one JSON document, in one write.
+bool writeDiagnosticsJson(const std::string &path);
+
 #endif
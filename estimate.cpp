@@ -0,0 +1,289 @@
+#include "estimate.h"
+#include "error.h"
+#include "isa.h"
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <string_view>
+
+// Most blocks and loops listed by reportEstimate
+static const size_t MAX_BLOCKS = 256;
+static const size_t MAX_LOOPS = 16;
+
+namespace {
+
+// What the estimator needs from one image word
+struct WordInfo {
+    uint32_t defs = 0;       // registers written, as a bitmask ($0 left out)
+    uint32_t uses = 0;
+    bool load = false;
+    bool control = false;
+    bool conditional = false;
+    bool call = false;       // jal: control comes back to the next block
+    bool indirect = false;   // jr: successor unknown
+    uint32_t target = UINT32_MAX;
+};
+
+WordInfo inspect(uint32_t word, uint32_t pc) {
+    WordInfo w;
+    const InstructionDef *def = decodeInstruction(word);
+    if (!def) return w;
+    uint32_t rs = (word >> 21) & 0x1F;
+    uint32_t rt = (word >> 16) & 0x1F;
+    uint32_t rd = (word >> 11) & 0x1F;
+    auto bit = [](uint32_t reg) { return 1u << reg; };
+
+    switch (def->pattern) {
+        case OperandPattern::R_DST_SRC_TMP:
+            w.defs = bit(rd);
+            w.uses = bit(rs) | bit(rt);
+            break;
+        case OperandPattern::R_DST_TMP_SHAMT:
+            w.defs = bit(rd);
+            w.uses = bit(rt);
+            break;
+        case OperandPattern::R_SRC_ONLY:
+            w.uses = bit(rs);
+            w.control = w.indirect = true;
+            break;
+        case OperandPattern::I_TMP_SRC_IMM:
+            w.defs = bit(rt);
+            w.uses = bit(rs);
+            break;
+        case OperandPattern::I_TMP_IMM:
+            w.defs = bit(rt);
+            break;
+        case OperandPattern::I_SRC_TMP_LABEL:
+            w.uses = bit(rs) | bit(rt);
+            w.control = true;
+            // beq $x, $x is taken every time
+            w.conditional = !(rs == rt && def->mnemonic == "beq");
+            w.target = static_cast<uint32_t>(branchTarget(
+                static_cast<int16_t>(word & 0xFFFF), static_cast<int>(pc)));
+            break;
+        case OperandPattern::I_TMP_OFF_SRC:
+            if (def->mnemonic[0] == 'l') {
+                w.load = true;
+                w.defs = bit(rt);
+                w.uses = bit(rs);
+            } else {
+                w.uses = bit(rs) | bit(rt);
+            }
+            break;
+        case OperandPattern::J_LABEL:
+            w.control = true;
+            w.call = def->mnemonic == "jal";
+            if (w.call) w.defs = bit(31);
+            w.target = word & 0x03FFFFFF;
+            break;
+    }
+    w.defs &= ~1u;
+    return w;
+}
+
+// LOOP_TRIPS^n, saturating
+uint64_t tripPower(unsigned n) {
+    uint64_t p = 1;
+    for (unsigned i = 0; i < n && p < UINT64_MAX / LOOP_TRIPS; i++) p *= LOOP_TRIPS;
+    return p;
+}
+
+} // namespace
+
+CostEstimate estimateCost(const std::vector<uint32_t> &image, const CostModel &model) {
+    CostEstimate est;
+    est.model = model;
+    uint32_t n = static_cast<uint32_t>(image.size());
+    est.instructions = n;
+    if (n == 0) return est;
+
+    std::vector<WordInfo> words(n);
+    for (uint32_t pc = 0; pc < n; pc++) words[pc] = inspect(image[pc], pc);
+
+    // Leaders: word 0, every target, and the word after each branch or
+    // jump (after its delay slot, unless the slot is itself a target)
+    std::vector<char> starts(n + 1, 0);
+    starts[0] = 1;
+    for (const auto &w : words) {
+        if (w.target < n) starts[w.target] = 1;
+    }
+    for (uint32_t pc = 0; pc < n; pc++) {
+        if (!words[pc].control) continue;
+        uint32_t after = model.delaySlots && pc + 1 < n && !starts[pc + 1] ? pc + 2 : pc + 1;
+        starts[std::min(after, n)] = 1;
+    }
+
+    std::vector<uint32_t> blockOf(n);
+    for (uint32_t pc = 0; pc < n; pc++) {
+        if (starts[pc]) est.blocks.push_back({pc, pc, 0, false, 0, {}, 0});
+        blockOf[pc] = static_cast<uint32_t>(est.blocks.size() - 1);
+        est.blocks.back().end = pc + 1;
+    }
+
+    // Cost each block and link it to its successors
+    uint32_t nb = static_cast<uint32_t>(est.blocks.size());
+    std::vector<std::vector<uint32_t>> preds(nb);
+    std::vector<std::pair<uint32_t, uint32_t>> backEdges;   // latch, header
+    for (uint32_t b = 0; b < nb; b++) {
+        BlockCost &block = est.blocks[b];
+        for (uint32_t pc = block.begin + 1; pc < block.end; pc++) {
+            const WordInfo &prev = words[pc - 1];
+            if (prev.load && (prev.defs & words[pc].uses)) block.loadUseStalls++;
+        }
+
+        // With delay slots the branch is normally the second-last word
+        uint32_t term = UINT32_MAX;
+        if (model.delaySlots && block.end - block.begin >= 2 && words[block.end - 2].control) {
+            term = block.end - 2;
+        } else if (words[block.end - 1].control) {
+            term = block.end - 1;
+        }
+        block.branch = term != UINT32_MAX;
+        block.cycles = (block.end - block.begin) +
+                       static_cast<uint64_t>(block.loadUseStalls) * model.loadUsePenalty +
+                       (block.branch ? model.branchPenalty : 0);
+
+        auto link = [&](uint32_t to, bool loopEdge) {
+            if (std::find(block.succs.begin(), block.succs.end(), to) != block.succs.end()) return;
+            block.succs.push_back(to);
+            preds[to].push_back(b);
+            if (loopEdge && to <= b) backEdges.push_back({b, to});
+        };
+        bool fallsThrough = true;
+        if (block.branch) {
+            const WordInfo &w = words[term];
+            // A jump to itself is the halt idiom, not a loop
+            if (w.target == term) continue;
+            if (w.target < n) link(blockOf[w.target], !w.call);
+            fallsThrough = w.conditional || w.call;
+        }
+        if (fallsThrough && block.end < n) link(blockOf[block.end], false);
+    }
+
+    // Natural loop of each back edge: walk predecessors from the latch,
+    // stopping at the header. Back edges to one header share a loop.
+    std::vector<std::vector<char>> bodies;
+    std::vector<uint32_t> headers;
+    for (const auto &edge : backEdges) {
+        uint32_t latch = edge.first, header = edge.second;
+        size_t li = std::find(headers.begin(), headers.end(), header) - headers.begin();
+        if (li == headers.size()) {
+            headers.push_back(header);
+            bodies.emplace_back(nb, 0);
+            bodies.back()[header] = 1;
+        }
+        std::vector<char> &body = bodies[li];
+        std::vector<uint32_t> work;
+        if (!body[latch]) {
+            body[latch] = 1;
+            work.push_back(latch);
+        }
+        while (!work.empty()) {
+            uint32_t b = work.back();
+            work.pop_back();
+            for (uint32_t p : preds[b]) {
+                if (!body[p]) {
+                    body[p] = 1;
+                    work.push_back(p);
+                }
+            }
+        }
+    }
+
+    for (const auto &body : bodies) {
+        for (uint32_t b = 0; b < nb; b++) est.blocks[b].depth += body[b];
+    }
+    for (size_t li = 0; li < headers.size(); li++) {
+        LoopCost loop{headers[li], {}, est.blocks[headers[li]].depth, 0, 0, 0};
+        for (uint32_t b = 0; b < nb; b++) {
+            if (!bodies[li][b]) continue;
+            const BlockCost &block = est.blocks[b];
+            loop.blocks.push_back(b);
+            loop.instructions += block.end - block.begin;
+            loop.cycles += block.cycles;
+            loop.weight += block.cycles * tripPower(block.depth - loop.depth);
+        }
+        est.loops.push_back(std::move(loop));
+    }
+    std::stable_sort(est.loops.begin(), est.loops.end(), [&](const LoopCost &a, const LoopCost &b) {
+        if (a.weight != b.weight) return a.weight > b.weight;
+        return est.blocks[a.header].begin < est.blocks[b.header].begin;
+    });
+
+    for (const auto &block : est.blocks) est.cycles += block.cycles;
+    return est;
+}
+
+void reportEstimate(const CostEstimate &estimate, const SymbolTable *symbols) {
+    // First label at each address
+    std::vector<std::string_view> labels;
+    if (symbols) {
+        for (uint32_t id = 0; id < symbols->size(); id++) {
+            if (!symbols->isDefined(id)) continue;
+            size_t addr = static_cast<size_t>(symbols->address(id));
+            if (addr >= labels.size()) labels.resize(addr + 1);
+            if (labels[addr].empty()) labels[addr] = symbols->name(id);
+        }
+    }
+    auto labelAt = [&](uint32_t addr) {
+        return addr < labels.size() ? std::string(labels[addr]) : std::string();
+    };
+
+    const CostModel &model = estimate.model;
+    char buf[200];
+    std::snprintf(buf, sizeof(buf),
+                  "Estimate: %zu blocks, %zu loops, %llu instructions, %llu cycles "
+                  "with every block run once",
+                  estimate.blocks.size(), estimate.loops.size(),
+                  static_cast<unsigned long long>(estimate.instructions),
+                  static_cast<unsigned long long>(estimate.cycles));
+    reportInfo(buf);
+    std::snprintf(buf, sizeof(buf), "Pipeline model: load-use penalty %u, branch penalty %u%s",
+                  model.loadUsePenalty, model.branchPenalty,
+                  model.delaySlots ? ", delay slots" : "");
+    reportInfo(buf);
+
+    reportInfo("Blocks:");
+    for (size_t i = 0; i < estimate.blocks.size() && i < MAX_BLOCKS; i++) {
+        const BlockCost &block = estimate.blocks[i];
+        std::snprintf(buf, sizeof(buf), "  0x%03x-0x%03x %5u words %7llu cycles %3u stalls  depth %u",
+                      block.begin, block.end - 1, block.end - block.begin,
+                      static_cast<unsigned long long>(block.cycles), block.loadUseStalls,
+                      block.depth);
+        std::string line = buf;
+        if (!block.succs.empty()) {
+            line += "  ->";
+            for (uint32_t s : block.succs) {
+                std::snprintf(buf, sizeof(buf), " 0x%03x", estimate.blocks[s].begin);
+                line += buf;
+            }
+        }
+        std::string name = labelAt(block.begin);
+        if (!name.empty()) line += "  (" + name + ")";
+        reportInfo(line);
+    }
+    if (estimate.blocks.size() > MAX_BLOCKS) {
+        reportInfo("  ... " + std::to_string(estimate.blocks.size() - MAX_BLOCKS) + " more");
+    }
+
+    if (estimate.loops.empty()) return;
+    reportInfo("Loops (most expensive first):");
+    for (size_t i = 0; i < estimate.loops.size() && i < MAX_LOOPS; i++) {
+        const LoopCost &loop = estimate.loops[i];
+        uint32_t begin = estimate.blocks[loop.header].begin;
+        std::snprintf(buf, sizeof(buf),
+                      "  %2zu. 0x%03x depth %u: %zu blocks, %llu words, %llu cycles per "
+                      "iteration, weight %llu",
+                      i + 1, begin, loop.depth, loop.blocks.size(),
+                      static_cast<unsigned long long>(loop.instructions),
+                      static_cast<unsigned long long>(loop.cycles),
+                      static_cast<unsigned long long>(loop.weight));
+        std::string line = buf;
+        std::string name = labelAt(begin);
+        if (!name.empty()) line += "  (" + name + ")";
+        reportInfo(line);
+    }
+    if (estimate.loops.size() > MAX_LOOPS) {
+        reportInfo("  ... " + std::to_string(estimate.loops.size() - MAX_LOOPS) + " more");
+    }
+}
@@ -0,0 +1,62 @@
+#ifndef ESTIMATE_H
+#define ESTIMATE_H
+
+#include "symtab.h"
+#include <cstdint>
+#include <vector>
+
+// Static cost estimate for an encoded image (--estimate): a control-flow
+// graph over its basic blocks, the loops found from its back edges, and
+// cycle counts under a simple in-order pipeline model. Nothing is run.
+
+struct CostModel {
+    unsigned loadUsePenalty = 1;   // a load whose result is read by the next word
+    unsigned branchPenalty = 1;    // every block that ends in a branch or jump
+    bool delaySlots = false;       // the word after a branch or jump is in its block
+};
+
+struct BlockCost {
+    uint32_t begin;                // image words [begin, end)
+    uint32_t end;
+    uint32_t loadUseStalls;
+    bool branch;                   // ends in a branch or jump
+    uint64_t cycles;               // one pass through the block
+    std::vector<uint32_t> succs;   // successor block indices
+    unsigned depth;                // number of loops the block is in
+};
+
+struct LoopCost {
+    uint32_t header;               // block index
+    std::vector<uint32_t> blocks;  // body, including the header, by address
+    unsigned depth;                // 1 for an outermost loop
+    uint64_t instructions;
+    uint64_t cycles;               // every body block once
+    uint64_t weight;               // cycles, with inner loops run LOOP_TRIPS times
+};
+
+// Nested loops are assumed to run this many iterations per outer iteration
+// when loops are ranked.
+constexpr unsigned LOOP_TRIPS = 10;
+
+struct CostEstimate {
+    CostModel model;
+    std::vector<BlockCost> blocks;   // by address
+    std::vector<LoopCost> loops;     // most expensive first
+    uint64_t instructions = 0;
+    uint64_t cycles = 0;             // every block once
+};
+
+// Build the CFG from branch and jump targets in `image` and cost it.
+// A back edge is a branch or jump to its own block or an earlier one;
+// its loop is every block that reaches the branch without passing the
+// target. Loops sharing a header are merged. jr has no known successor,
+// and a jump to itself (the usual halt) has none at all.
+CostEstimate estimateCost(const std::vector<uint32_t> &image,
+                          const CostModel &model = CostModel());
+
+// Print the block table and the ranked loops as Info diagnostics. Blocks
+// and loops are named after a label at their first word when `symbols`
+// is given.
+void reportEstimate(const CostEstimate &estimate, const SymbolTable *symbols = nullptr);
+
+#endif
@@ -0,0 +1,278 @@
+#include "ir.h"
+#include "error.h"
+#include "perfect_hash.h"
+#include <string>
+
+// What each operand position of a pattern holds. An Off(set) is a number
+// or the name of a data label.
+enum class Slot : uint8_t { Reg, Imm, Sym, Off };
+
+static const Slot *slotsFor(OperandPattern pattern) {
+    static const Slot RRR[] = {Slot::Reg, Slot::Reg, Slot::Reg};
+    static const Slot RRI[] = {Slot::Reg, Slot::Reg, Slot::Imm};
+    static const Slot RI[]  = {Slot::Reg, Slot::Imm};
+    static const Slot RRS[] = {Slot::Reg, Slot::Reg, Slot::Sym};
+    static const Slot ROR[] = {Slot::Reg, Slot::Off, Slot::Reg};
+    static const Slot S[]   = {Slot::Sym};
+    switch (pattern) {
+        case OperandPattern::R_DST_SRC_TMP:   return RRR;
+        case OperandPattern::R_DST_TMP_SHAMT: return RRI;
+        case OperandPattern::R_SRC_ONLY:      return RRR;
+        case OperandPattern::I_TMP_SRC_IMM:   return RRI;
+        case OperandPattern::I_TMP_IMM:       return RI;
+        case OperandPattern::I_SRC_TMP_LABEL: return RRS;
+        case OperandPattern::I_TMP_OFF_SRC:   return ROR;
+        case OperandPattern::J_LABEL:         return S;
+    }
+    return RRR;
+}
+
+static Operand lowerOperand(Program &program, Slot slot, std::string_view text) {
+    switch (slot) {
+        case Slot::Reg: {
+            int n = lookupRegister(text);
+            if (n < 0) return {Operand::Kind::BadRegister, 0, text};
+            return {Operand::Kind::Register, static_cast<uint32_t>(n), text};
+        }
+        case Slot::Imm: {
+            int32_t value;
+            if (!parseInteger(text, value)) return {Operand::Kind::BadImmediate, 0, text};
+            return {Operand::Kind::Immediate, static_cast<uint32_t>(value), text};
+        }
+        case Slot::Sym:
+            return {Operand::Kind::Symbol, program.symbols.intern(text), text};
+        case Slot::Off: {
+            int32_t value;
+            if (parseInteger(text, value)) {
+                return {Operand::Kind::Immediate, static_cast<uint32_t>(value), text};
+            }
+            char c = text.empty() ? '0' : text[0];
+            bool name = (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || c == '_' || c == '.';
+            if (!name) return {Operand::Kind::BadImmediate, 0, text};
+            return {Operand::Kind::Symbol, program.symbols.intern(text), text};
+        }
+    }
+    return {Operand::Kind::BadImmediate, 0, text};
+}
+
+void lowerInstruction(Program &program, const ParsedLine &line) {
+    IRInst inst;
+    inst.def = findInstruction(line.mnemonic);
+    inst.mnemonic = line.mnemonic;
+    inst.rawText = line.rawText;
+    inst.lineNumber = line.lineNumber;
+    inst.firstOperand = static_cast<uint32_t>(program.operands.size());
+    inst.numOperands = static_cast<uint8_t>(line.operands.size());
+
+    if (inst.lowered()) {
+        int expected = expectedOperandCount(inst.def->pattern);
+        const Slot *slots = slotsFor(inst.def->pattern);
+        for (int i = 0; i < expected; i++) {
+            program.operands.push_back(lowerOperand(program, slots[i], line.operands[i]));
+        }
+    }
+    program.insts.push_back(inst);
+}
+
+void lowerDirective(Program &program, const ParsedLine &line, bool &inData) {
+    struct Entry {
+        std::string_view name;
+        DataDirective::Kind kind;
+    };
+    static const Entry DIRECTIVES[] = {
+        {".org", DataDirective::Kind::Org},     {".word", DataDirective::Kind::Word},
+        {".half", DataDirective::Kind::Half},   {".byte", DataDirective::Kind::Byte},
+        {".space", DataDirective::Kind::Space}, {".align", DataDirective::Kind::Align},
+        {".incbin", DataDirective::Kind::Incbin},
+    };
+    std::string_view args = line.operands.empty() ? std::string_view() : line.operands[0];
+
+    // .globl a, b: allowed in either segment, so a data label is kept
+    if (equalsIgnoreCase(line.mnemonic, ".globl") || equalsIgnoreCase(line.mnemonic, ".global")) {
+        if (inData && !line.label.empty()) {
+            program.dataLabels.push_back({program.symbols.intern(line.label),
+                                          static_cast<uint32_t>(program.data.size()),
+                                          line.lineNumber});
+        }
+        size_t start = 0;
+        while (start <= args.size()) {
+            size_t comma = args.find(',', start);
+            if (comma == std::string_view::npos) comma = args.size();
+            std::string_view name = args.substr(start, comma - start);
+            size_t first = name.find_first_not_of(" \t");
+            size_t last = name.find_last_not_of(" \t");
+            if (first == std::string_view::npos) {
+                reportError(line.lineNumber, DiagCode::OperandCount, "'" +
+                            std::string(line.mnemonic) + "' needs a label");
+                return;
+            }
+            name = name.substr(first, last - first + 1);
+            program.globals.push_back({program.symbols.intern(name), line.lineNumber});
+            start = comma + 1;
+        }
+        return;
+    }
+
+    // A label on a .text or .data line belongs to the segment it opens
+    if (equalsIgnoreCase(line.mnemonic, ".text") || equalsIgnoreCase(line.mnemonic, ".data")) {
+        inData = line.mnemonic[1] == 'd' || line.mnemonic[1] == 'D';
+        if (!inData && !args.empty()) {
+            reportError(line.lineNumber, DiagCode::BadDirective, ".text takes no arguments");
+        }
+        if (inData && !line.label.empty()) {
+            program.dataLabels.push_back({program.symbols.intern(line.label),
+                                          static_cast<uint32_t>(program.data.size()),
+                                          line.lineNumber});
+        }
+        // .data addr is .data followed by .org addr
+        if (inData && !args.empty()) {
+            program.data.push_back({DataDirective::Kind::Org, args, line.lineNumber});
+        }
+        return;
+    }
+
+    for (const auto &d : DIRECTIVES) {
+        if (!equalsIgnoreCase(line.mnemonic, d.name)) continue;
+        if (!inData) {
+            reportError(line.lineNumber, DiagCode::WrongSegment, "'" + std::string(line.mnemonic) +
+                        "' is only allowed in .data");
+            return;
+        }
+        if (!line.label.empty()) {
+            program.dataLabels.push_back({program.symbols.intern(line.label),
+                                          static_cast<uint32_t>(program.data.size()),
+                                          line.lineNumber});
+        }
+        program.data.push_back({d.kind, args, line.lineNumber});
+        return;
+    }
+    reportError(line.lineNumber, DiagCode::UnknownDirective, "unknown directive '" +
+                std::string(line.mnemonic) + "'");
+}
+
+Program buildProgram(const std::vector<ParsedLine> &lines) {
+    Program program;
+    program.insts.reserve(lines.size());
+    program.operands.reserve(lines.size() * 3);
+
+    bool inData = false;
+    for (const auto &line : lines) {
+        if (errorLimitReached()) break;
+        bool directive = isDirective(line.mnemonic);
+        if (directive) {
+            lowerDirective(program, line, inData);
+        } else if (inData && !line.label.empty()) {
+            program.dataLabels.push_back({program.symbols.intern(line.label),
+                                          static_cast<uint32_t>(program.data.size()),
+                                          line.lineNumber});
+        }
+        if (!line.label.empty() && !inData) {
+            uint32_t id = program.symbols.intern(line.label);
+            if (program.symbols.isDefined(id)) {
+                reportError(line.lineNumber, DiagCode::DuplicateLabel, "duplicate label '" +
+                            std::string(line.label) + "'");
+            }
+            uint32_t index = static_cast<uint32_t>(program.insts.size());
+            program.symbols.define(id, static_cast<int>(index));
+            program.labels.push_back({id, index, line.lineNumber});
+        }
+        if (directive || line.mnemonic.empty()) continue;
+        if (inData) {
+            reportError(line.lineNumber, DiagCode::WrongSegment, "instruction in .data");
+        } else {
+            lowerInstruction(program, line);
+        }
+    }
+
+    return program;
+}
+
+void Program::bindLabels() {
+    for (const auto &label : labels) {
+        symbols.define(label.symbol, static_cast<int>(label.index));
+    }
+}
+
+RegisterEffects effectsOf(const Program &program, const IRInst &inst) {
+    RegisterEffects fx;
+    if (!inst.lowered()) {
+        fx.opaque = true;
+        return fx;
+    }
+    const Operand *ops = program.operandsOf(inst);
+    int n = expectedOperandCount(inst.def->pattern);
+    for (int i = 0; i < n; i++) {
+        if (ops[i].kind == Operand::Kind::BadRegister ||
+            ops[i].kind == Operand::Kind::BadImmediate) {
+            fx.opaque = true;
+            return fx;
+        }
+    }
+
+    auto bit = [](uint32_t reg) { return 1u << (reg & 31); };
+    switch (inst.def->pattern) {
+        case OperandPattern::R_DST_SRC_TMP:
+            fx.defs = bit(ops[0].value);
+            fx.uses = bit(ops[1].value) | bit(ops[2].value);
+            break;
+        case OperandPattern::R_DST_TMP_SHAMT:
+        case OperandPattern::I_TMP_SRC_IMM:
+            fx.defs = bit(ops[0].value);
+            fx.uses = bit(ops[1].value);
+            break;
+        case OperandPattern::R_SRC_ONLY:
+            fx.uses = bit(ops[0].value);
+            fx.control = true;
+            break;
+        case OperandPattern::I_TMP_IMM:
+            fx.defs = bit(ops[0].value);
+            break;
+        case OperandPattern::I_SRC_TMP_LABEL:
+            fx.uses = bit(ops[0].value) | bit(ops[1].value);
+            fx.control = true;
+            break;
+        case OperandPattern::I_TMP_OFF_SRC:
+            // lw/lbu/lhu load into rt; sw/sb/sh store it
+            if (inst.def->mnemonic[0] == 'l') {
+                fx.load = true;
+                fx.defs = bit(ops[0].value);
+                fx.uses = bit(ops[2].value);
+            } else {
+                fx.store = true;
+                fx.uses = bit(ops[0].value) | bit(ops[2].value);
+            }
+            break;
+        case OperandPattern::J_LABEL:
+            if (inst.def->mnemonic == "jal") fx.defs = bit(31);
+            fx.control = true;
+            break;
+    }
+    fx.defs &= ~1u;
+    return fx;
+}
+
+std::vector<BasicBlock> basicBlocks(const Program &program, bool delaySlots) {
+    size_t n = program.insts.size();
+    std::vector<char> starts(n + 1, 0);
+    for (const auto &label : program.labels) starts[label.index] = 1;
+    for (size_t i = 0; i < n; i++) {
+        if (!program.insts[i].def) continue;
+        OperandPattern p = program.insts[i].def->pattern;
+        if (p == OperandPattern::R_SRC_ONLY || p == OperandPattern::I_SRC_TMP_LABEL ||
+            p == OperandPattern::J_LABEL) {
+            // The delay slot stays with its branch unless it is a target
+            size_t after = (delaySlots && i + 1 < n && !starts[i + 1]) ? i + 2 : i + 1;
+            if (after <= n) starts[after] = 1;
+        }
+    }
+
+    std::vector<BasicBlock> blocks;
+    uint32_t begin = 0;
+    for (size_t i = 1; i <= n; i++) {
+        if (i == n || starts[i]) {
+            if (i > begin) blocks.push_back({begin, static_cast<uint32_t>(i)});
+            begin = static_cast<uint32_t>(i);
+        }
+    }
+    return blocks;
+}
@@ -0,0 +1,118 @@
+#ifndef IR_H
+#define IR_H
+
+#include "data.h"
+#include "isa.h"
+#include "lexer.h"
+#include "symtab.h"
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// Operand after lowering. Registers and immediates are parsed once, labels
+// are interned to symbol IDs. Operands that fail to parse keep their text
+// so the encoder can report them in source order.
+struct Operand {
+    enum class Kind : uint8_t {
+        Register,       // value = register number
+        Immediate,      // value = 32-bit pattern
+        Symbol,         // value = symbol ID
+        BadRegister,    // text is not a register
+        BadImmediate,   // text is not an integer
+    };
+
+    Kind kind;
+    uint32_t value;
+    std::string_view text;   // as written
+};
+
+struct IRInst {
+    const InstructionDef *def;   // null if the mnemonic is unknown
+    std::string_view mnemonic;   // as written, for diagnostics
+    std::string_view rawText;    // source line for output comments
+    int lineNumber;
+    uint32_t firstOperand;       // index of the first lowered operand
+    uint8_t numOperands;         // operand count as written
+
+    // Operands are lowered only when the mnemonic is known and enough
+    // operands were given; otherwise the encoder reports the problem.
+    bool lowered() const {
+        return def && numOperands >= expectedOperandCount(def->pattern);
+    }
+};
+
+struct LabelDef {
+    uint32_t symbol;
+    uint32_t index;              // instruction the label points at
+    int lineNumber;
+};
+
+// A name given to .globl, exported when the program is an object file
+struct GlobalDecl {
+    uint32_t symbol;
+    int lineNumber;
+};
+
+// Compact form of a program. Instruction i lives at address i, operands sit
+// in one arena shared by every instruction, and labels are symbol IDs.
+struct Program {
+    SymbolTable symbols;
+    std::vector<IRInst> insts;
+    std::vector<Operand> operands;
+    std::vector<LabelDef> labels;   // definitions, in source order
+    std::vector<GlobalDecl> globals;
+
+    // The .data segment, laid out by layoutData() once the text is final
+    std::vector<DataDirective> data;
+    std::vector<DataLabel> dataLabels;
+
+    const Operand *operandsOf(const IRInst &inst) const {
+        return operands.data() + inst.firstOperand;
+    }
+
+    // Bind every label to the address of the instruction it points at.
+    // Call again after a pass moves instructions.
+    void bindLabels();
+};
+
+// Registers read and written by an instruction, as bitmasks over $0..$31,
+// derived from its operand pattern. Writes to $0 are not defs.
+struct RegisterEffects {
+    uint32_t defs = 0;
+    uint32_t uses = 0;
+    bool load = false;
+    bool store = false;
+    bool control = false;   // branch or jump; the next word is its delay slot
+    bool opaque = false;    // unknown or malformed; passes must not move it
+};
+
+RegisterEffects effectsOf(const Program &program, const IRInst &inst);
+
+// Straight-line run of instructions [begin, end). A block starts at every
+// labeled instruction and after every branch or jump. With delaySlots the
+// delay slot stays with its branch unless it is labeled, in which case it
+// starts a block of its own; without, the word after a branch is only run
+// on fall-through and starts the next block.
+struct BasicBlock {
+    uint32_t begin;
+    uint32_t end;
+};
+
+std::vector<BasicBlock> basicBlocks(const Program &program, bool delaySlots);
+
+// Lower parsed lines (aliases resolved, pseudos expanded) into a Program,
+// defining each text label at the address of the next instruction and
+// collecting the .data segment. Duplicate text labels are reported here;
+// everything else is left for the encoder and layoutData().
+Program buildProgram(const std::vector<ParsedLine> &lines);
+
+// Append one line's instruction to `program` (labels are not touched).
+void lowerInstruction(Program &program, const ParsedLine &line);
+
+// Handle a directive line: .text and .data switch `inData`, data
+// directives are appended to program.data, and .globl (or .global) names
+// go to program.globals. Reports unknown directives and data directives
+// outside .data.
+void lowerDirective(Program &program, const ParsedLine &line, bool &inData);
+
+#endif
@@ -0,0 +1,117 @@
+#include "isa.h"
+#include "perfect_hash.h"
+
+// Instruction table: mnemonic -> definition
+static constexpr InstructionDef INSTRUCTIONS[] = {
+    {"add",    0x00, 0x20, OperandPattern::R_DST_SRC_TMP},
+    {"addi",   0x08, 0x00, OperandPattern::I_TMP_SRC_IMM},
+    {"addiu",  0x09, 0x00, OperandPattern::I_TMP_SRC_IMM},
+    {"addu",   0x00, 0x21, OperandPattern::R_DST_SRC_TMP},
+    {"and",    0x00, 0x24, OperandPattern::R_DST_SRC_TMP},
+    {"andi",   0x0C, 0x00, OperandPattern::I_TMP_SRC_IMM},
+    {"beq",    0x04, 0x00, OperandPattern::I_SRC_TMP_LABEL},
+    {"bne",    0x05, 0x00, OperandPattern::I_SRC_TMP_LABEL},
+    {"j",      0x02, 0x00, OperandPattern::J_LABEL},
+    {"jal",    0x03, 0x00, OperandPattern::J_LABEL},
+    {"jr",     0x00, 0x08, OperandPattern::R_SRC_ONLY},
+    {"lbu",    0x24, 0x00, OperandPattern::I_TMP_OFF_SRC},
+    {"lhu",    0x25, 0x00, OperandPattern::I_TMP_OFF_SRC},
+    {"lui",    0x0F, 0x00, OperandPattern::I_TMP_IMM},
+    {"lw",     0x23, 0x00, OperandPattern::I_TMP_OFF_SRC},
+    {"nor",    0x00, 0x27, OperandPattern::R_DST_SRC_TMP},
+    {"or",     0x00, 0x25, OperandPattern::R_DST_SRC_TMP},
+    {"ori",    0x0D, 0x00, OperandPattern::I_TMP_SRC_IMM},
+    {"sb",     0x28, 0x00, OperandPattern::I_TMP_OFF_SRC},
+    {"sh",     0x29, 0x00, OperandPattern::I_TMP_OFF_SRC},
+    {"sll",    0x00, 0x00, OperandPattern::R_DST_TMP_SHAMT},
+    {"slt",    0x00, 0x2A, OperandPattern::R_DST_SRC_TMP},
+    {"slti",   0x0A, 0x00, OperandPattern::I_TMP_SRC_IMM},
+    {"sltiu",  0x0B, 0x00, OperandPattern::I_TMP_SRC_IMM},
+    {"sltu",   0x00, 0x2B, OperandPattern::R_DST_SRC_TMP},
+    {"srl",    0x00, 0x02, OperandPattern::R_DST_TMP_SHAMT},
+    {"sub",    0x00, 0x22, OperandPattern::R_DST_SRC_TMP},
+    {"subu",   0x00, 0x23, OperandPattern::R_DST_SRC_TMP},
+    {"sw",     0x2B, 0x00, OperandPattern::I_TMP_OFF_SRC},
+};
+
+static constexpr size_t NUM_INSTRUCTIONS =
+    sizeof(INSTRUCTIONS) / sizeof(INSTRUCTIONS[0]);
+
+static constexpr PerfectHashIndex<NUM_INSTRUCTIONS, 128> MNEMONIC_INDEX(
+    [](size_t i) { return INSTRUCTIONS[i].mnemonic; });
+static_assert(MNEMONIC_INDEX.valid(), "no perfect hash seed for mnemonics");
+
+static constexpr const InstructionDef *lookupInstruction(std::string_view m) {
+    int idx = MNEMONIC_INDEX.find(m);
+    return idx < 0 ? nullptr : &INSTRUCTIONS[idx];
+}
+
+static_assert(NUM_INSTRUCTIONS == 29, "instruction table must list all 29 instructions");
+
+// Compile-time encoding checks, one per instruction, against known-good words
+// (taken from the reference Output.mif).
+static constexpr uint32_t enc(std::string_view m, uint32_t a, uint32_t b = 0,
+                              uint32_t c = 0) {
+    return packInstruction(*lookupInstruction(m), a, b, c);
+}
+static_assert(enc("add",   1, 1, 6)            == 0x00260820, "add");
+static_assert(enc("addi",  6, 0, 0x0001)       == 0x20060001, "addi");
+static_assert(enc("addiu", 11, 11, 0x0808)     == 0x256B0808, "addiu");
+static_assert(enc("addu",  9, 8, 1)            == 0x01014821, "addu");
+static_assert(enc("and",   24, 19, 18)         == 0x0272C024, "and");
+static_assert(enc("andi",  25, 19, 0x9F93)     == 0x32799F93, "andi");
+static_assert(enc("beq",   4, 5, 0x15)         == 0x10850015, "beq");
+static_assert(enc("bne",   9, 14, uint32_t(-11)) == 0x152EFFF5, "bne");
+static_assert(enc("j",     0x0D)               == 0x0800000D, "j");
+static_assert(enc("jal",   0x25)               == 0x0C000025, "jal");
+static_assert(enc("jr",    30)                 == 0x03C00008, "jr");
+static_assert(enc("lbu",   22, 4, 9)           == 0x91360004, "lbu");
+static_assert(enc("lhu",   20, uint32_t(-1), 8) == 0x9514FFFF, "lhu");
+static_assert(enc("lui",   1, 0xFFFF)          == 0x3C01FFFF, "lui");
+static_assert(enc("lw",    18, uint32_t(-1), 8) == 0x8D12FFFF, "lw");
+static_assert(enc("nor",   9, 4, 5)            == 0x00854827, "nor");
+static_assert(enc("or",    20, 20, 21)         == 0x0295A025, "or");
+static_assert(enc("ori",   1, 1, 0xFFFE)       == 0x3421FFFE, "ori");
+static_assert(enc("sb",    22, 12, 9)          == 0xA136000C, "sb");
+static_assert(enc("sh",    18, 8, 9)           == 0xA5320008, "sh");
+static_assert(enc("sll",   12, 8, 4)           == 0x00086100, "sll");
+static_assert(enc("slt",   9, 10, 12)          == 0x014C482A, "slt");
+static_assert(enc("slti",  14, 0, 0x0001)      == 0x280E0001, "slti");
+static_assert(enc("sltiu", 24, 11, 0x7FFF)     == 0x2D787FFF, "sltiu");
+static_assert(enc("sltu",  16, 10, 12)         == 0x014C802B, "sltu");
+static_assert(enc("srl",   10, 2, 1)           == 0x00025042, "srl");
+static_assert(enc("sub",   7, 0, 6)            == 0x00063822, "sub");
+static_assert(enc("subu",  8, 8, 10)           == 0x010A4023, "subu");
+static_assert(enc("sw",    4, 0x0000, 8)       == 0xAD040000, "sw");
+
+static_assert(branchTarget(branchOffset(9, 3), 3) == 9, "forward branch round trip");
+static_assert(branchTarget(branchOffset(2, 7), 7) == 2, "backward branch round trip");
+
+const InstructionDef *findInstruction(std::string_view mnemonic) {
+    return lookupInstruction(mnemonic);
+}
+
+const InstructionDef *decodeInstruction(uint32_t word) {
+    uint32_t opcode = word >> 26;
+    uint32_t funct = word & 0x3F;
+    for (const auto &def : INSTRUCTIONS) {
+        if (def.opcode != opcode) continue;
+        if (opcode == 0 && def.funct != funct) continue;
+        return &def;
+    }
+    return nullptr;
+}
+
+int expectedOperandCount(OperandPattern pattern) {
+    switch (pattern) {
+        case OperandPattern::R_DST_SRC_TMP:   return 3;
+        case OperandPattern::R_DST_TMP_SHAMT:  return 3;
+        case OperandPattern::R_SRC_ONLY:        return 1;
+        case OperandPattern::I_TMP_SRC_IMM:     return 3;
+        case OperandPattern::I_TMP_IMM:         return 2;
+        case OperandPattern::I_SRC_TMP_LABEL:   return 3;
+        case OperandPattern::I_TMP_OFF_SRC:     return 3; // $t, offset, $s (lexer splits offset($s))
+        case OperandPattern::J_LABEL:           return 1;
+    }
+    return 0;
+}
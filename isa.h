@@ -0,0 +1,110 @@
+#ifndef ISA_H
+#define ISA_H
+
+#include <cstdint>
+#include <string_view>
+
+enum class OperandPattern {
+    R_DST_SRC_TMP,    // add $d, $s, $t
+    R_DST_TMP_SHAMT,  // sll $d, $t, shamt
+    R_SRC_ONLY,        // jr $s
+    I_TMP_SRC_IMM,     // addi $t, $s, imm
+    I_TMP_IMM,         // lui $t, imm
+    I_SRC_TMP_LABEL,   // beq $s, $t, label
+    I_TMP_OFF_SRC,     // lw $t, offset($s)
+    J_LABEL,           // j label / jal label
+};
+
+struct InstructionDef {
+    std::string_view mnemonic;
+    uint8_t opcode;        // 6-bit primary opcode
+    uint8_t funct;         // 6-bit function code for R-type, 0 otherwise
+    OperandPattern pattern;
+};
+
+// Field packing. Each field is masked to its width so out-of-range values
+// wrap the same way the old bitset<N> conversion did.
+constexpr uint32_t packR(uint32_t opcode, uint32_t rs, uint32_t rt,
+                         uint32_t rd, uint32_t shamt, uint32_t funct) {
+    return ((opcode & 0x3Fu) << 26) | ((rs & 0x1Fu) << 21) |
+           ((rt & 0x1Fu) << 16) | ((rd & 0x1Fu) << 11) |
+           ((shamt & 0x1Fu) << 6) | (funct & 0x3Fu);
+}
+
+constexpr uint32_t packI(uint32_t opcode, uint32_t rs, uint32_t rt,
+                         uint32_t imm) {
+    return ((opcode & 0x3Fu) << 26) | ((rs & 0x1Fu) << 21) |
+           ((rt & 0x1Fu) << 16) | (imm & 0xFFFFu);
+}
+
+constexpr uint32_t packJ(uint32_t opcode, uint32_t target) {
+    return ((opcode & 0x3Fu) << 26) | (target & 0x03FFFFFFu);
+}
+
+// Pack an instruction from its operand values, given in source order
+// (after registers, immediates and labels have been resolved to numbers).
+constexpr uint32_t packInstruction(const InstructionDef &def,
+                                          uint32_t a, uint32_t b = 0,
+                                          uint32_t c = 0) {
+    switch (def.pattern) {
+        case OperandPattern::R_DST_SRC_TMP:   // rd, rs, rt
+            return packR(def.opcode, b, c, a, 0, def.funct);
+        case OperandPattern::R_DST_TMP_SHAMT: // rd, rt, shamt
+            return packR(def.opcode, 0, b, a, c, def.funct);
+        case OperandPattern::R_SRC_ONLY:      // rs
+            return packR(def.opcode, a, 0, 0, 0, def.funct);
+        case OperandPattern::I_TMP_SRC_IMM:   // rt, rs, imm
+            return packI(def.opcode, b, a, c);
+        case OperandPattern::I_TMP_IMM:       // rt, imm
+            return packI(def.opcode, 0, a, b);
+        case OperandPattern::I_SRC_TMP_LABEL: // rs, rt, offset
+            return packI(def.opcode, a, b, c);
+        case OperandPattern::I_TMP_OFF_SRC:   // rt, offset, rs
+            return packI(def.opcode, c, a, b);
+        case OperandPattern::J_LABEL:         // target
+            return packJ(def.opcode, a);
+    }
+    return 0;
+}
+
+// Branch offset from the instruction at `address` to `target`.
+constexpr int branchOffset(int target, int address) {
+    // Replicate original asymmetric formula:
+    // Forward:  offset = (target - current) - 1
+    // Backward: offset = -(current - target)
+    if (target > address) {
+        return (target - address) - 1;
+    }
+    return -(address - target);
+}
+
+// Inverse of branchOffset: where a branch at `address` with the encoded
+// 16-bit `offset` (sign-extended) goes. Non-negative offsets are forward
+// branches. Offset 0 decodes as address + 1, so a branch to itself cannot
+// be told apart from a branch to the next word.
+constexpr int branchTarget(int offset, int address) {
+    return offset >= 0 ? address + 1 + offset : address + offset;
+}
+
+// Whether a branch offset fits the signed 16-bit field.
+constexpr bool branchOffsetFits(int offset) {
+    return offset >= -32768 && offset <= 32767;
+}
+
+// Whether j/jal can reach `target`: the 26-bit field is the target's word
+// address.
+constexpr bool jumpTargetFits(int target) {
+    return target >= 0 && target < (1 << 26);
+}
+
+// Definition for a mnemonic (case-insensitive), or null if unknown.
+const InstructionDef *findInstruction(std::string_view mnemonic);
+
+// Definition an encoded word belongs to, by opcode (and funct for R-type),
+// or null if it is not one of the supported instructions.
+const InstructionDef *decodeInstruction(uint32_t word);
+
+// Operands a pattern needs, counting offset($s) as two.
+int expectedOperandCount(OperandPattern pattern);
+
+#endif
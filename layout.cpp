@@ -0,0 +1,498 @@
+#include "layout.h"
+#include "error.h"
+#include <algorithm>
+#include <cstdlib>
+
+bool readProfile(const std::string &path, const SymbolTable &symbols, size_t words,
+                 std::vector<uint64_t> &counts) {
+    SourceBuffer file;
+    if (!file.open(path)) {
+        reportError(0, DiagCode::Io, "cannot open profile '" + path + "'");
+        return false;
+    }
+    counts.assign(words, 0);
+
+    std::string_view text = file.text();
+    size_t pos = 0;
+    int lineNum = 0;
+    size_t pastEnd = 0, unknown = 0;
+    std::string firstUnknown;
+    bool ok = true;
+    while (pos < text.size() && !errorLimitReached()) {
+        size_t eol = text.find('\n', pos);
+        if (eol == std::string_view::npos) eol = text.size();
+        std::string_view line = text.substr(pos, eol - pos);
+        pos = eol + 1;
+        lineNum++;
+        line = line.substr(0, line.find('#'));
+
+        // Fields are separated by blanks, commas or colons
+        const char *SEPARATORS = " \t\r,:";
+        std::string_view fields[2];
+        size_t numFields = 0;
+        for (size_t i = line.find_first_not_of(SEPARATORS); i != std::string_view::npos;
+             i = line.find_first_not_of(SEPARATORS, i)) {
+            size_t j = std::min(line.find_first_of(SEPARATORS, i), line.size());
+            if (numFields < 2) fields[numFields] = line.substr(i, j - i);
+            numFields++;
+            i = j;
+        }
+        if (numFields == 0) continue;
+
+        auto bad = [&](const std::string &why) {
+            reportError(0, DiagCode::BadProfile, "profile '" + path + "', line " +
+                        std::to_string(lineNum) + ": " + why);
+            ok = false;
+        };
+        if (numFields != 2) {
+            bad("expected an address or label and a count");
+            continue;
+        }
+        std::string countText(fields[1]);
+        char *end = nullptr;
+        unsigned long long count = std::strtoull(countText.c_str(), &end, 10);
+        if (countText[0] == '-' || *end != '\0') {
+            bad("invalid count '" + countText + "'");
+            continue;
+        }
+
+        uint64_t index;
+        std::string_view key = fields[0];
+        if (key[0] >= '0' && key[0] <= '9') {
+            std::string keyText(key);
+            index = std::strtoull(keyText.c_str(), &end, 0);
+            if (*end != '\0') {
+                bad("invalid address '" + keyText + "'");
+                continue;
+            }
+        } else {
+            uint32_t id = symbols.find(key);
+            if (id == SymbolTable::NONE || !symbols.isDefined(id)) {
+                if (unknown++ == 0) firstUnknown = std::string(key);
+                continue;
+            }
+            index = static_cast<uint64_t>(symbols.address(id));
+        }
+        if (index >= words) {
+            pastEnd++;
+            continue;
+        }
+        counts[index] += count;
+    }
+
+    if (pastEnd > 0) {
+        reportWarning(0, DiagCode::BadProfile, "profile '" + path + "' has " +
+                      std::to_string(pastEnd) + " entries past the end of the program");
+    }
+    if (unknown > 0) {
+        reportWarning(0, DiagCode::BadProfile, "profile '" + path + "' names " +
+                      std::to_string(unknown) + " unknown labels, such as '" + firstUnknown + "'");
+    }
+    return ok;
+}
+
+static const uint32_t NONE = UINT32_MAX;
+
+namespace {
+
+enum class Exit : uint8_t {
+    Fall,     // runs into `fall`
+    Branch,   // beq/bne: to `taken`, or on to `fall`
+    Jump,     // j, or beq $x,$x: always to `taken`
+    Call,     // jal: returns to `fall`
+    Fixed,    // a branch to something other than a block; on to `fall`
+    Stop,     // jr, or j to something other than a block
+};
+
+struct Block {
+    uint32_t begin;
+    uint32_t end;           // delay slot included
+    uint32_t control;       // the branch or jump, or NONE
+    Exit exit;
+    uint32_t taken;         // block index
+    uint32_t fall;          // block index; one past the last block is the end
+    uint64_t count;
+    uint64_t takenWeight;   // estimated edge counts
+    uint64_t fallWeight;
+    bool slotLabeled;       // something jumps straight to the delay slot
+};
+
+struct Edge {
+    uint32_t from;
+    uint32_t to;
+    uint64_t weight;
+};
+
+// Chains of blocks that will fall through into each other, merged with
+// union-find; each root knows its chain's head and tail
+class Chains {
+public:
+    explicit Chains(size_t n) : parent_(n), head_(n), tail_(n), next_(n, NONE) {
+        for (uint32_t b = 0; b < n; b++) parent_[b] = head_[b] = tail_[b] = b;
+    }
+
+    uint32_t root(uint32_t b) {
+        while (parent_[b] != b) b = parent_[b] = parent_[parent_[b]];
+        return b;
+    }
+    uint32_t head(uint32_t b) { return head_[root(b)]; }
+    uint32_t next(uint32_t b) const { return next_[b]; }
+
+    // Append the chain headed by `to` to the chain ending in `from`
+    bool link(uint32_t from, uint32_t to) {
+        uint32_t a = root(from), b = root(to);
+        if (a == b || tail_[a] != from || head_[b] != to) return false;
+        next_[from] = to;
+        parent_[b] = a;
+        tail_[a] = tail_[b];
+        return true;
+    }
+
+private:
+    std::vector<uint32_t> parent_, head_, tail_, next_;
+};
+
+bool isControl(const IRInst &inst) {
+    OperandPattern p = inst.def->pattern;
+    return p == OperandPattern::R_SRC_ONLY || p == OperandPattern::I_SRC_TMP_LABEL ||
+           p == OperandPattern::J_LABEL;
+}
+
+} // namespace
+
+LayoutStats layoutBlocks(Program &program, const std::vector<uint64_t> &counts,
+                         bool delaySlots, SourceBuffer &source) {
+    LayoutStats stats;
+    auto &insts = program.insts;
+    uint32_t n = static_cast<uint32_t>(insts.size());
+    if (n == 0 || counts.size() < n) return stats;
+
+    // Block starts. Malformed code (the encoder reports it) or a branch in
+    // a delay slot leaves the program as it is.
+    std::vector<char> start(n + 1, 0), inSlot(n + 1, 0), labeled(n + 1, 0);
+    start[0] = 1;
+    for (uint32_t i = 0; i < n; i++) {
+        if (effectsOf(program, insts[i]).opaque) return stats;
+        if (!isControl(insts[i])) continue;
+        if (inSlot[i]) return stats;
+        uint32_t after = i + 1;
+        if (delaySlots && after < n) inSlot[after++] = 1;
+        start[after] = 1;
+    }
+    for (const auto &label : program.labels) {
+        labeled[label.index] = 1;
+        if (label.index < n && !inSlot[label.index]) start[label.index] = 1;
+    }
+
+    std::vector<Block> blocks;
+    std::vector<uint32_t> blockAt(n + 1, NONE);
+    for (uint32_t i = 0; i < n;) {
+        uint32_t j = i + 1;
+        while (j < n && !start[j]) j++;
+        blockAt[i] = static_cast<uint32_t>(blocks.size());
+        blocks.push_back({i, j, NONE, Exit::Fall, NONE, NONE, 0, 0, 0, false});
+        i = j;
+    }
+    const uint32_t END = static_cast<uint32_t>(blocks.size());
+    blockAt[n] = END;
+    stats.blocks = blocks.size();
+
+    // Block a label operand names, NONE if it is not a block start
+    auto targetBlock = [&](const Operand &op) {
+        if (op.kind != Operand::Kind::Symbol || !program.symbols.isDefined(op.value)) return NONE;
+        int address = program.symbols.address(op.value);
+        return address < 0 || static_cast<uint32_t>(address) > n ? NONE : blockAt[address];
+    };
+
+    for (uint32_t b = 0; b < END; b++) {
+        Block &blk = blocks[b];
+        blk.fall = b + 1;
+        for (uint32_t i = blk.begin; i < blk.end; i++) blk.count = std::max(blk.count, counts[i]);
+
+        uint32_t last = blk.end - 1;
+        if (isControl(insts[last])) {
+            blk.control = last;
+        } else if (delaySlots && inSlot[last] && last > blk.begin) {
+            blk.control = last - 1;
+            blk.slotLabeled = labeled[last];
+        } else {
+            continue;
+        }
+
+        const IRInst &inst = insts[blk.control];
+        const Operand *ops = program.operandsOf(inst);
+        switch (inst.def->pattern) {
+            case OperandPattern::J_LABEL:
+                blk.taken = targetBlock(ops[0]);
+                if (inst.def->mnemonic == "jal") {
+                    blk.exit = Exit::Call;
+                } else {
+                    blk.exit = blk.taken == NONE || blk.taken == END ? Exit::Stop : Exit::Jump;
+                }
+                break;
+            case OperandPattern::I_SRC_TMP_LABEL:
+                blk.taken = targetBlock(ops[2]);
+                if (blk.taken == NONE || blk.taken == END) {
+                    blk.exit = Exit::Fixed;
+                } else if (inst.def->mnemonic == "beq" && ops[0].value == ops[1].value) {
+                    blk.exit = Exit::Jump;
+                } else {
+                    blk.exit = Exit::Branch;
+                }
+                break;
+            default:
+                blk.exit = Exit::Stop;
+                break;
+        }
+    }
+
+    // The return point of a call runs as often as the call, even when the
+    // profile only names labels
+    for (uint32_t b = 0; b + 1 < END; b++) {
+        if (blocks[b].exit == Exit::Call && blocks[b + 1].count == 0) {
+            blocks[b + 1].count = blocks[b].count;
+        }
+    }
+
+    // Edge counts. A branch splits its block's count between its two
+    // successors; the split is exact when one of them has no other way in.
+    std::vector<uint32_t> preds(END + 1, 0);
+    for (const Block &blk : blocks) {
+        if (blk.exit != Exit::Stop && blk.exit != Exit::Jump) preds[blk.fall]++;
+        if (blk.exit == Exit::Branch || blk.exit == Exit::Jump) preds[blk.taken]++;
+    }
+    for (Block &blk : blocks) {
+        if (blk.exit != Exit::Branch) {
+            (blk.exit == Exit::Jump ? blk.takenWeight : blk.fallWeight) = blk.count;
+            continue;
+        }
+        uint64_t fallCount = blk.fall == END ? 0 : blocks[blk.fall].count;
+        if (preds[blk.fall] != 1 && preds[blk.taken] == 1) {
+            blk.takenWeight = std::min(blk.count, blocks[blk.taken].count);
+            blk.fallWeight = blk.count - blk.takenWeight;
+        } else {
+            blk.fallWeight = std::min(blk.count, fallCount);
+            blk.takenWeight = blk.count - blk.fallWeight;
+        }
+        stats.takenBefore += blk.takenWeight;
+    }
+    for (const Block &blk : blocks) {
+        if (blk.exit == Exit::Jump) stats.takenBefore += blk.count;
+        stats.executedBefore += blk.count * (blk.end - blk.begin);
+    }
+
+    // Whether block b is entered by falling out of the block before it
+    auto fallsInto = [&](uint32_t b) {
+        if (b == 0) return false;
+        const Block &prev = blocks[b - 1];
+        return prev.exit != Exit::Stop && prev.exit != Exit::Jump && prev.fallWeight > 0;
+    };
+
+    // Chain along the hottest edges first. A zero-count edge only keeps two
+    // blocks that never ran in their original order, so cold code leaves
+    // the hot chains and stays as it was. A loop whose back edge is a
+    // branch is not rotated away from the block that falls into it: that
+    // trades the taken back edge for a j on the way in and an inverted
+    // exit, and saves no instruction.
+    std::vector<Edge> edges;
+    for (uint32_t b = 0; b < END; b++) {
+        const Block &blk = blocks[b];
+        if (blk.exit == Exit::Branch || blk.exit == Exit::Jump) {
+            edges.push_back({b, blk.taken, blk.takenWeight});
+        }
+        if (blk.exit != Exit::Stop && blk.exit != Exit::Jump && blk.fall != END) {
+            edges.push_back({b, blk.fall, blk.fallWeight});
+        }
+    }
+    std::stable_sort(edges.begin(), edges.end(), [](const Edge &a, const Edge &b) {
+        if (a.weight != b.weight) return a.weight > b.weight;
+        return (a.to == a.from + 1) > (b.to == b.from + 1);
+    });
+    Chains chains(END);
+    for (const Edge &e : edges) {
+        // The entry block stays first
+        if (e.to == 0) continue;
+        if (e.weight == 0 && (e.to != e.from + 1 || blocks[e.from].count > 0 ||
+                              blocks[e.to].count > 0)) {
+            continue;
+        }
+        if (e.to <= e.from && blocks[e.from].exit == Exit::Branch && fallsInto(e.to)) continue;
+        chains.link(e.from, e.to);
+    }
+
+    // The entry chain, then chains by their hottest block, then cold ones,
+    // each group in original order
+    struct ChainInfo {
+        uint32_t head;
+        uint64_t hottest;
+    };
+    std::vector<ChainInfo> order;
+    for (uint32_t b = 0; b < END; b++) {
+        if (chains.head(b) != b) continue;
+        uint64_t hottest = 0;
+        for (uint32_t c = b; c != NONE; c = chains.next(c)) {
+            hottest = std::max(hottest, blocks[c].count);
+        }
+        order.push_back({b, hottest});
+    }
+    std::stable_sort(order.begin() + 1, order.end(), [](const ChainInfo &a, const ChainInfo &b) {
+        return a.hottest > b.hottest;
+    });
+    std::vector<uint32_t> layout;
+    layout.reserve(END);
+    for (const ChainInfo &chain : order) {
+        for (uint32_t c = chain.head; c != NONE; c = chains.next(c)) layout.push_back(c);
+    }
+
+    // A label for each block a new j or inverted branch goes to
+    std::vector<uint32_t> blockLabel(END + 1, NONE);
+    for (const auto &label : program.labels) {
+        uint32_t b = blockAt[label.index];
+        if (b != NONE && blockLabel[b] == NONE) blockLabel[b] = label.symbol;
+    }
+    auto labelOf = [&](uint32_t b) {
+        if (blockLabel[b] != NONE) return blockLabel[b];
+        uint32_t index = b == END ? n : blocks[b].begin;
+        std::string name = "__block" + std::to_string(index);
+        while (program.symbols.find(name) != SymbolTable::NONE) name += "_";
+        uint32_t id = program.symbols.intern(source.store(name));
+        program.labels.push_back({id, index, 0});
+        blockLabel[b] = id;
+        return id;
+    };
+
+    // Plan what each block needs where it now sits, and what that costs
+    struct Placement {
+        uint32_t next;       // block that follows, END after the last
+        bool invert;         // branch to the old fall-through instead
+        bool dropJump;       // j to the block that now follows
+        bool appendJump;     // j to the fall-through, which moved away
+    };
+    std::vector<Placement> plan(layout.size());
+    const uint64_t jumpWords = delaySlots ? 2 : 1;
+    stats.executedAfter = stats.executedBefore;
+    for (size_t p = 0; p < layout.size(); p++) {
+        uint32_t b = layout[p];
+        const Block &blk = blocks[b];
+        Placement &place = plan[p];
+        place.next = p + 1 < layout.size() ? layout[p + 1] : END;
+        place.dropJump = blk.exit == Exit::Jump && blk.taken == place.next && !blk.slotLabeled;
+        place.invert = blk.exit == Exit::Branch && blk.fall != place.next &&
+                       blk.taken == place.next && !blk.slotLabeled;
+        place.appendJump = false;
+        if (b != p) stats.moved++;
+
+        switch (blk.exit) {
+            case Exit::Branch:
+                if (place.invert) {
+                    stats.takenAfter += blk.fallWeight;
+                    stats.branchesInverted++;
+                } else if (blk.fall == place.next) {
+                    stats.takenAfter += blk.takenWeight;
+                } else {
+                    stats.takenAfter += blk.takenWeight + blk.fallWeight;
+                    place.appendJump = true;
+                }
+                break;
+            case Exit::Jump:
+                if (place.dropJump) {
+                    stats.jumpsRemoved++;
+                    stats.executedAfter -= blk.count;
+                } else {
+                    stats.takenAfter += blk.count;
+                }
+                break;
+            case Exit::Fall:
+            case Exit::Call:
+            case Exit::Fixed:
+                if (blk.fall != place.next) {
+                    stats.takenAfter += blk.fallWeight;
+                    place.appendJump = true;
+                }
+                break;
+            case Exit::Stop:
+                break;
+        }
+        if (place.appendJump) {
+            stats.jumpsInserted++;
+            stats.executedAfter += blk.fallWeight * jumpWords;
+        }
+    }
+
+    // Keep the program as it is unless fewer instructions run, or as many
+    // with fewer taken branches and jumps
+    stats.applied = stats.executedAfter < stats.executedBefore ||
+                    (stats.executedAfter == stats.executedBefore &&
+                     stats.takenAfter < stats.takenBefore);
+    if (!stats.applied) return stats;
+
+    const InstructionDef *beq = findInstruction("beq");
+    const InstructionDef *bne = findInstruction("bne");
+    const InstructionDef *jump = findInstruction("j");
+    const InstructionDef *sll = findInstruction("sll");
+    uint32_t nopOperands = NONE;
+    std::vector<IRInst> out;
+    out.reserve(n + stats.jumpsInserted * jumpWords);
+    std::vector<uint32_t> newIndex(n + 1);
+
+    // j to block `b` (and a nop for its delay slot), after `from`
+    auto appendJump = [&](const IRInst &from, uint32_t b) {
+        uint32_t id = labelOf(b);
+        std::string_view name = program.symbols.name(id);
+        IRInst j = from;
+        j.def = jump;
+        j.mnemonic = jump->mnemonic;
+        j.rawText = source.store("j " + std::string(name));
+        j.firstOperand = static_cast<uint32_t>(program.operands.size());
+        j.numOperands = 1;
+        program.operands.push_back({Operand::Kind::Symbol, id, name});
+        out.push_back(j);
+        if (delaySlots) {
+            if (nopOperands == NONE) {
+                nopOperands = static_cast<uint32_t>(program.operands.size());
+                program.operands.push_back({Operand::Kind::Register, 0, "$0"});
+                program.operands.push_back({Operand::Kind::Register, 0, "$0"});
+                program.operands.push_back({Operand::Kind::Immediate, 0, "0"});
+            }
+            IRInst nop = from;
+            nop.def = sll;
+            nop.mnemonic = sll->mnemonic;
+            nop.rawText = "nop";
+            nop.firstOperand = nopOperands;
+            nop.numOperands = 3;
+            out.push_back(nop);
+        }
+    };
+
+    for (size_t p = 0; p < layout.size(); p++) {
+        const Block &blk = blocks[layout[p]];
+        const Placement &place = plan[p];
+        for (uint32_t i = blk.begin; i < blk.end; i++) {
+            newIndex[i] = static_cast<uint32_t>(out.size());
+            if (i == blk.control && place.dropJump) continue;
+            out.push_back(insts[i]);
+            if (i != blk.control || !place.invert) continue;
+
+            // Branch to the old fall-through instead; the old target follows
+            IRInst &branch = out.back();
+            branch.def = branch.def == beq ? bne : beq;
+            branch.mnemonic = branch.def->mnemonic;
+            uint32_t id = labelOf(blk.fall);
+            std::string_view name = program.symbols.name(id);
+            Operand *ops = &program.operands[branch.firstOperand];
+            ops[2] = {Operand::Kind::Symbol, id, name};
+            branch.rawText = source.store(std::string(branch.mnemonic) + " " +
+                                          std::string(ops[0].text) + ", " +
+                                          std::string(ops[1].text) + ", " + std::string(name));
+        }
+        if (place.appendJump) {
+            appendJump(insts[blk.exit == Exit::Branch ? blk.control : blk.end - 1], blk.fall);
+        }
+    }
+    newIndex[n] = static_cast<uint32_t>(out.size());
+    insts = std::move(out);
+
+    for (auto &label : program.labels) label.index = newIndex[label.index];
+    program.bindLabels();
+    return stats;
+}
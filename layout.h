@@ -0,0 +1,56 @@
+#ifndef LAYOUT_H
+#define LAYOUT_H
+
+#include "ir.h"
+#include "source.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct LayoutStats {
+    size_t blocks = 0;
+    size_t moved = 0;              // blocks no longer at their original position
+    size_t jumpsInserted = 0;
+    size_t jumpsRemoved = 0;       // j to the block that now follows
+    size_t branchesInverted = 0;
+    uint64_t takenBefore = 0;      // taken branches and jumps, estimated
+    uint64_t takenAfter = 0;       //   from the profile
+    uint64_t executedBefore = 0;   // instructions executed, estimated the
+    uint64_t executedAfter = 0;    //   same way, inserted j and nops included
+    bool applied = false;          // false: the program was left as it is
+};
+
+// Read an execution profile into per-instruction counts. Each line is a
+// word address (decimal or 0x hex) or a text label, then a count:
+//     0x01c 4096
+//     loop  4096
+// '#' starts a comment. Counts for the same instruction add up. Reports a
+// file that cannot be read or a malformed line, and warns once about
+// addresses past the program and names that are not text labels.
+bool readProfile(const std::string &path, const SymbolTable &symbols, size_t words,
+                 std::vector<uint64_t> &counts);
+
+// Profile-guided block layout (--profile). Blocks end after each branch or
+// jump (and its delay slot, with delaySlots). Edge counts are estimated
+// from the block counts, and blocks are chained greedily along the hottest
+// edges so the likely successor of a block falls through; chains are then
+// placed hottest first, the entry block first of all, and blocks that
+// never ran at the end. A loop closed by a branch is not rotated away from
+// the block that falls into it. To keep each block's successors:
+//   - a branch whose taken block now follows is inverted (beq <-> bne),
+//   - a block whose fall-through successor no longer follows gets a j to
+//     it (and a nop, with delaySlots),
+//   - a j to the block that now follows is removed.
+// The block after a jal stays next, since the call returns there. The new
+// order is only applied if it is estimated to execute fewer instructions,
+// or as many with fewer taken branches and jumps; otherwise the program is
+// left as it is and applied is false. Labels are rebound; blocks that need
+// a label for a new j get one named "__block<N>" (source.store keeps the
+// name). Code that computes instruction addresses without labels is not
+// adjusted. A branch or jump in a delay slot leaves the program as it is,
+// with blocks == 0.
+LayoutStats layoutBlocks(Program &program, const std::vector<uint64_t> &counts,
+                         bool delaySlots, SourceBuffer &source);
+
+#endif
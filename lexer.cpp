@@ -1,206 +1,291 @@
 #include "lexer.h"
 #include "error.h"
-#include <fstream>
-#include <algorithm>
-#include <cctype>
-#include <sstream>
-#include <map>
+#include "perfect_hash.h"
+#include <charconv>
+#include <cstdio>
 #include <cstdint>
+#include <string>
 
-static std::string trim(const std::string &s) {
+static std::string_view trim(std::string_view s) {
     size_t start = s.find_first_not_of(" \t\r\n");
-    if (start == std::string::npos) return "";
+    if (start == std::string_view::npos) return std::string_view();
     size_t end = s.find_last_not_of(" \t\r\n");
     return s.substr(start, end - start + 1);
 }
 
-static std::string toLower(const std::string &s) {
-    std::string result = s;
-    std::transform(result.begin(), result.end(), result.begin(), ::tolower);
-    return result;
-}
+// Named registers, indexed by register number
+static constexpr std::string_view REGISTER_NAMES[32] = {
+    "$zero", "$at", "$v0", "$v1", "$a0", "$a1", "$a2", "$a3",
+    "$t0",   "$t1", "$t2", "$t3", "$t4", "$t5", "$t6", "$t7",
+    "$s0",   "$s1", "$s2", "$s3", "$s4", "$s5", "$s6", "$s7",
+    "$t8",   "$t9", "$k0", "$k1", "$gp", "$sp", "$fp", "$ra",
+};
 
-static const std::map<std::string, std::string> REGISTER_ALIASES = {
-    {"$zero", "$0"},  {"$at", "$1"},
-    {"$v0", "$2"},    {"$v1", "$3"},
-    {"$a0", "$4"},    {"$a1", "$5"},    {"$a2", "$6"},    {"$a3", "$7"},
-    {"$t0", "$8"},    {"$t1", "$9"},    {"$t2", "$10"},   {"$t3", "$11"},
-    {"$t4", "$12"},   {"$t5", "$13"},   {"$t6", "$14"},   {"$t7", "$15"},
-    {"$s0", "$16"},   {"$s1", "$17"},   {"$s2", "$18"},   {"$s3", "$19"},
-    {"$s4", "$20"},   {"$s5", "$21"},   {"$s6", "$22"},   {"$s7", "$23"},
-    {"$t8", "$24"},   {"$t9", "$25"},
-    {"$k0", "$26"},   {"$k1", "$27"},
-    {"$gp", "$28"},   {"$sp", "$29"},   {"$fp", "$30"},   {"$ra", "$31"},
+// Canonical numeric spelling, indexed by register number
+static constexpr std::string_view REGISTER_NUMBERS[32] = {
+    "$0",  "$1",  "$2",  "$3",  "$4",  "$5",  "$6",  "$7",
+    "$8",  "$9",  "$10", "$11", "$12", "$13", "$14", "$15",
+    "$16", "$17", "$18", "$19", "$20", "$21", "$22", "$23",
+    "$24", "$25", "$26", "$27", "$28", "$29", "$30", "$31",
 };
 
-// Parse an immediate value (hex with 0x prefix, or decimal)
-static int32_t parsePseudoImmediate(const std::string &s) {
-    if (s.size() > 2 && s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) {
-        return static_cast<int32_t>(std::stoul(s.substr(2), nullptr, 16));
+static constexpr PerfectHashIndex<32, 128> REGISTER_INDEX(
+    [](size_t i) { return REGISTER_NAMES[i]; });
+static_assert(REGISTER_INDEX.valid(), "no perfect hash seed for register names");
+static_assert(REGISTER_INDEX.find("$ZERO") == 0 && REGISTER_INDEX.find("$ra") == 31,
+              "register name lookup");
+
+int lookupRegister(std::string_view operand) {
+    if (operand.size() < 2 || operand[0] != '$') return -1;
+
+    // Numeric form: decode the digits directly
+    if (operand[1] >= '0' && operand[1] <= '9') {
+        int n = 0;
+        for (size_t i = 1; i < operand.size(); i++) {
+            char c = operand[i];
+            if (c < '0' || c > '9') return -1;
+            n = n * 10 + (c - '0');
+            if (n > 31) return -1;
+        }
+        return n;
     }
-    return std::stoi(s);
+
+    return REGISTER_INDEX.find(operand);
 }
 
-std::vector<ParsedLine> tokenize(const std::string &filename) {
-    std::vector<ParsedLine> lines;
-    std::ifstream file(filename);
+bool parseInteger(std::string_view s, int32_t &value) {
+    bool negative = false;
+    if (!s.empty() && (s[0] == '-' || s[0] == '+')) {
+        negative = s[0] == '-';
+        s.remove_prefix(1);
+    }
+    int base = 10;
+    if (s.size() > 2 && s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) {
+        base = 16;
+        s.remove_prefix(2);
+    }
+    if (s.empty()) return false;
 
-    if (!file.is_open()) {
-        reportError(0, "cannot open file '" + filename + "'");
-        return lines;
+    uint64_t magnitude = 0;
+    auto result = std::from_chars(s.data(), s.data() + s.size(), magnitude, base);
+    if (result.ec != std::errc() || result.ptr != s.data() + s.size()) return false;
+
+    if (base == 16) {
+        // Hex literals name a bit pattern: 0xFFFFFFFF is -1
+        if (magnitude > 0xFFFFFFFFull) return false;
+        uint32_t bits = static_cast<uint32_t>(magnitude);
+        value = static_cast<int32_t>(negative ? 0u - bits : bits);
+        return true;
     }
+    if (magnitude > (negative ? 0x80000000ull : 0x7FFFFFFFull)) return false;
+    value = negative ? static_cast<int32_t>(0u - static_cast<uint32_t>(magnitude))
+                     : static_cast<int32_t>(magnitude);
+    return true;
+}
 
-    std::string rawLine;
-    int lineNum = 0;
+LineLexer::LineLexer(const SourceBuffer &source)
+    : scan_(source.text()) {}
 
-    while (std::getline(file, rawLine)) {
-        lineNum++;
+// Selectors for ScannedText lookups
+static uint64_t newlines(const CharMasks &m) { return m.newline; }
+static uint64_t hashes(const CharMasks &m) { return m.hash; }
+static uint64_t colons(const CharMasks &m) { return m.colon; }
+static uint64_t blanks(const CharMasks &m) { return m.blank; }
+static uint64_t nonBlanks(const CharMasks &m) { return ~(m.blank | m.cr | m.newline); }
+static uint64_t separators(const CharMasks &m) { return m.comma | m.open | m.close; }
 
-        // Strip comments at '#'
-        std::string line = rawLine;
-        size_t commentPos = line.find('#');
-        if (commentPos != std::string::npos) {
-            line = line.substr(0, commentPos);
-        }
+static bool isTrimmed(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+bool LineLexer::next(ParsedLine &parsed) {
+    const std::string_view text = scan_.text();
+    const size_t size = text.size();
+    while (pos_ < size) {
+        size_t start = pos_;
+        size_t eol = scan_.find(start, size, newlines);
+        pos_ = eol + 1;
+        int lineNum = ++lineNum_;
 
-        line = trim(line);
-        if (line.empty()) continue;
+        // Strip the comment at '#', then surrounding blanks
+        size_t end = scan_.find(start, eol, hashes);
+        size_t first = scan_.find(start, end, nonBlanks);
+        if (first == end) continue;
+        while (isTrimmed(text[end - 1])) end--;
 
-        ParsedLine parsed;
+        parsed = ParsedLine();
         parsed.lineNumber = lineNum;
-        parsed.rawText = trim(rawLine);
+        size_t rawEnd = eol;
+        while (isTrimmed(text[rawEnd - 1])) rawEnd--;
+        parsed.rawText = text.substr(first, rawEnd - first);
 
         // Check for label (colon)
-        size_t colonPos = line.find(':');
-        if (colonPos != std::string::npos) {
-            parsed.label = trim(line.substr(0, colonPos));
-            line = trim(line.substr(colonPos + 1));
-            if (line.empty()) {
+        size_t colon = scan_.find(first, end, colons);
+        if (colon != end) {
+            parsed.label = trim(text.substr(first, colon - first));
+            first = scan_.find(colon + 1, end, nonBlanks);
+            if (first == end) {
                 // Label-only line
-                lines.push_back(parsed);
-                continue;
+                return true;
             }
         }
 
         // Parse mnemonic (first token)
-        size_t spacePos = line.find_first_of(" \t");
-        if (spacePos == std::string::npos) {
+        size_t space = scan_.find(first, end, blanks);
+        parsed.mnemonic = text.substr(first, space - first);
+        if (space == end) {
             // Mnemonic only, no operands (e.g. "nop")
-            parsed.mnemonic = toLower(line);
-        } else {
-            parsed.mnemonic = toLower(line.substr(0, spacePos));
-            std::string rest = trim(line.substr(spacePos));
-
-            // Split operands by commas, respecting parentheses
-            std::vector<std::string> rawOperands;
-            std::string current;
-            int parenDepth = 0;
-            for (char c : rest) {
-                if (c == '(') parenDepth++;
-                if (c == ')') parenDepth--;
-                if (c == ',' && parenDepth == 0) {
-                    rawOperands.push_back(trim(current));
-                    current.clear();
-                } else {
-                    current += c;
-                }
-            }
-            if (!current.empty()) {
-                rawOperands.push_back(trim(current));
+            return true;
+        }
+        size_t rest = scan_.find(space, end, nonBlanks);
+
+        // Directive arguments may be any length; they are split later
+        if (parsed.mnemonic[0] == '.') {
+            parsed.operands.push_back(text.substr(rest, end - rest));
+            return true;
+        }
+
+        // Split operands at commas outside parentheses. offset($reg) is
+        // split in two at its first '(' and ')'.
+        bool overflow = false;
+        size_t opStart = rest;
+        size_t open = std::string_view::npos, close = std::string_view::npos;
+        auto addOperand = [&](size_t opEnd) {
+            if (open != std::string_view::npos && close != std::string_view::npos &&
+                close > open) {
+                overflow |= !parsed.operands.push_back(trim(text.substr(opStart, open - opStart)));
+                overflow |= !parsed.operands.push_back(trim(text.substr(open + 1, close - open - 1)));
+            } else {
+                overflow |= !parsed.operands.push_back(trim(text.substr(opStart, opEnd - opStart)));
             }
+        };
 
-            // Process each operand: split offset($reg) into two operands
-            for (const auto &op : rawOperands) {
-                size_t parenOpen = op.find('(');
-                size_t parenClose = op.find(')');
-                if (parenOpen != std::string::npos &&
-                    parenClose != std::string::npos &&
-                    parenClose > parenOpen) {
-                    std::string offset = trim(op.substr(0, parenOpen));
-                    std::string reg = trim(op.substr(parenOpen + 1,
-                                                      parenClose - parenOpen - 1));
-                    parsed.operands.push_back(offset);
-                    parsed.operands.push_back(reg);
-                } else {
-                    parsed.operands.push_back(op);
-                }
+        int parenDepth = 0;
+        scan_.forEach(rest, end, separators, [&](size_t i) {
+            char c = text[i];
+            if (c == '(') {
+                parenDepth++;
+                if (open == std::string_view::npos) open = i;
+            } else if (c == ')') {
+                parenDepth--;
+                if (close == std::string_view::npos) close = i;
+            } else if (parenDepth == 0) {
+                addOperand(i);
+                opStart = i + 1;
+                open = close = std::string_view::npos;
             }
-        }
+        });
+        if (opStart < end) addOperand(end);
 
-        lines.push_back(parsed);
+        if (overflow) {
+            reportError(lineNum, DiagCode::OperandCount, "too many operands");
+        }
+        return true;
     }
 
+    return false;
+}
+
+std::vector<ParsedLine> tokenize(const SourceBuffer &source) {
+    std::vector<ParsedLine> lines;
+    LineLexer lexer(source);
+    ParsedLine line;
+    while (!errorLimitReached() && lexer.next(line)) {
+        lines.push_back(line);
+    }
     return lines;
 }
 
+void resolveAliases(ParsedLine &line) {
+    for (auto &op : line.operands) {
+        if (op.size() < 2 || op[0] != '$') continue;
+        int n = REGISTER_INDEX.find(op);
+        if (n >= 0) {
+            op = REGISTER_NUMBERS[n];
+        }
+    }
+}
+
 void resolveAliases(std::vector<ParsedLine> &lines) {
     for (auto &line : lines) {
-        for (auto &op : line.operands) {
-            std::string lower = toLower(op);
-            auto it = REGISTER_ALIASES.find(lower);
-            if (it != REGISTER_ALIASES.end()) {
-                op = it->second;
-            }
-        }
+        resolveAliases(line);
     }
 }
 
-void expandPseudos(std::vector<ParsedLine> &lines) {
-    std::vector<ParsedLine> expanded;
+bool isPseudo(std::string_view mnemonic) {
+    return equalsIgnoreCase(mnemonic, "nop") || equalsIgnoreCase(mnemonic, "move") ||
+           equalsIgnoreCase(mnemonic, "li");
+}
 
-    for (auto &line : lines) {
-        if (line.mnemonic == "nop") {
-            // nop -> sll $0, $0, 0
-            line.mnemonic = "sll";
-            line.operands = {"$0", "$0", "0"};
-            expanded.push_back(line);
-        } else if (line.mnemonic == "move") {
-            // move $d, $s -> add $d, $s, $0
-            if (line.operands.size() < 2) {
-                reportError(line.lineNumber, "'move' requires 2 operands");
-                expanded.push_back(line);
-                continue;
-            }
-            line.mnemonic = "add";
-            line.operands = {line.operands[0], line.operands[1], "$0"};
-            expanded.push_back(line);
-        } else if (line.mnemonic == "li") {
-            // li $d, imm
-            if (line.operands.size() < 2) {
-                reportError(line.lineNumber, "'li' requires 2 operands");
-                expanded.push_back(line);
-                continue;
-            }
-            uint32_t val = static_cast<uint32_t>(parsePseudoImmediate(line.operands[1]));
-            if (val <= 0xFFFF) {
-                // Fits in 16 bits: ori $d, $0, imm
-                line.mnemonic = "ori";
-                line.operands = {line.operands[0], "$0", line.operands[1]};
-                expanded.push_back(line);
-            } else {
-                // Need lui + ori
-                uint16_t upper = static_cast<uint16_t>((val >> 16) & 0xFFFF);
-                uint16_t lower = static_cast<uint16_t>(val & 0xFFFF);
-
-                std::stringstream upperHex, lowerHex;
-                upperHex << "0x" << std::hex << upper;
-                lowerHex << "0x" << std::hex << lower;
-
-                ParsedLine luiLine = line;
-                luiLine.mnemonic = "lui";
-                luiLine.operands = {line.operands[0], upperHex.str()};
-                expanded.push_back(luiLine);
-
-                ParsedLine oriLine = line;
-                oriLine.mnemonic = "ori";
-                oriLine.label.clear(); // label already on lui
-                oriLine.operands = {line.operands[0], line.operands[0], lowerHex.str()};
-                expanded.push_back(oriLine);
-            }
+size_t expandPseudo(const ParsedLine &line, ParsedLine out[2], SourceBuffer &source) {
+    out[0] = line;
+    ParsedLine &first = out[0];
+
+    if (equalsIgnoreCase(line.mnemonic, "nop")) {
+        // nop -> sll $0, $0, 0
+        first.mnemonic = "sll";
+        first.operands = {"$0", "$0", "0"};
+    } else if (equalsIgnoreCase(line.mnemonic, "move")) {
+        // move $d, $s -> add $d, $s, $0
+        if (line.operands.size() < 2) {
+            reportError(line.lineNumber, DiagCode::OperandCount, "'move' requires 2 operands");
+            return 1;
+        }
+        first.mnemonic = "add";
+        first.operands = {line.operands[0], line.operands[1], "$0"};
+    } else if (equalsIgnoreCase(line.mnemonic, "li")) {
+        // li $d, imm
+        if (line.operands.size() < 2) {
+            reportError(line.lineNumber, DiagCode::OperandCount, "'li' requires 2 operands");
+            return 1;
+        }
+        int32_t imm;
+        if (!parseInteger(line.operands[1], imm)) {
+            reportError(line.lineNumber, DiagCode::BadImmediate, "invalid immediate value '" +
+                        std::string(line.operands[1]) + "'");
+            return 1;
+        }
+        uint32_t val = static_cast<uint32_t>(imm);
+        if (val <= 0xFFFF) {
+            // Fits in 16 bits: ori $d, $0, imm
+            first.mnemonic = "ori";
+            first.operands = {line.operands[0], "$0", line.operands[1]};
         } else {
-            expanded.push_back(line);
+            // Need lui + ori
+            uint16_t upper = static_cast<uint16_t>((val >> 16) & 0xFFFF);
+            uint16_t lower = static_cast<uint16_t>(val & 0xFFFF);
+
+            char upperHex[8], lowerHex[8];
+            std::snprintf(upperHex, sizeof(upperHex), "0x%x", upper);
+            std::snprintf(lowerHex, sizeof(lowerHex), "0x%x", lower);
+
+            first.mnemonic = "lui";
+            first.operands = {line.operands[0], source.store(upperHex)};
+
+            ParsedLine &second = out[1];
+            second = line;
+            second.mnemonic = "ori";
+            second.label = std::string_view(); // label already on lui
+            second.operands = {line.operands[0], line.operands[0], source.store(lowerHex)};
+            return 2;
         }
     }
+    return 1;
+}
+
+size_t expandPseudos(std::vector<ParsedLine> &lines, SourceBuffer &source) {
+    std::vector<ParsedLine> expanded;
+    expanded.reserve(lines.size());
+    size_t count = 0;
+
+    ParsedLine out[2];
+    for (const auto &line : lines) {
+        if (errorLimitReached()) break;
+        if (isPseudo(line.mnemonic)) count++;
+        size_t n = expandPseudo(line, out, source);
+        expanded.insert(expanded.end(), out, out + n);
+    }
 
-    lines = expanded;
+    lines = std::move(expanded);
+    return count;
 }
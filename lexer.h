@@ -1,19 +1,95 @@
 #ifndef LEXER_H
 #define LEXER_H
 
-#include <string>
+#include "scan.h"
+#include "source.h"
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <string_view>
 #include <vector>
 
+// Fixed-capacity operand list stored inline in ParsedLine. No instruction
+// takes more than three operands once offset($reg) is split, so four slots
+// leave room for the lexer to notice a stray extra operand.
+class OperandList {
+public:
+    static constexpr size_t CAPACITY = 4;
+
+    OperandList() = default;
+    OperandList(std::initializer_list<std::string_view> ops) {
+        for (auto op : ops) push_back(op);
+    }
+
+    size_t size() const { return count_; }
+    bool empty() const { return count_ == 0; }
+    std::string_view operator[](size_t i) const { return ops_[i]; }
+    std::string_view &operator[](size_t i) { return ops_[i]; }
+    const std::string_view *begin() const { return ops_; }
+    const std::string_view *end() const { return ops_ + count_; }
+    std::string_view *begin() { return ops_; }
+    std::string_view *end() { return ops_ + count_; }
+
+    // Returns false (and drops op) when the list is full
+    bool push_back(std::string_view op) {
+        if (count_ == CAPACITY) return false;
+        ops_[count_++] = op;
+        return true;
+    }
+
+private:
+    std::string_view ops_[CAPACITY];
+    uint8_t count_ = 0;
+};
+
+// All text fields are views into the SourceBuffer the line was lexed from
+// (or into strings it stores), so they stay valid as long as that buffer.
 struct ParsedLine {
     int lineNumber;                    // original source line (for errors)
-    std::string rawText;               // original line text (for MIF comments)
-    std::string label;                 // label defined on this line (empty if none)
-    std::string mnemonic;              // instruction mnemonic (lowercase)
-    std::vector<std::string> operands; // registers, immediates, labels
+    std::string_view rawText;          // original line text (for MIF comments)
+    std::string_view label;            // label defined on this line (empty if none)
+    std::string_view mnemonic;         // instruction mnemonic or directive (any case)
+    OperandList operands;              // registers, immediates, labels; a
+                                       // directive's arguments as one string
 };
 
-std::vector<ParsedLine> tokenize(const std::string &filename);
+// Incremental lexer: yields one non-blank line at a time, so callers can
+// process the source without materializing every ParsedLine. Line ends,
+// comments, labels and operand separators are found from byte-class masks
+// (see scan.h) rather than by searching each line several times.
+class LineLexer {
+public:
+    explicit LineLexer(const SourceBuffer &source);
+
+    // Fill `line` with the next non-blank line; false at end of input.
+    bool next(ParsedLine &line);
+
+private:
+    ScannedText scan_;
+    size_t pos_ = 0;
+    int lineNum_ = 0;
+};
+
+std::vector<ParsedLine> tokenize(const SourceBuffer &source);
+
+// Register number (0-31) for "$N" or a named register such as "$t0"
+// (case-insensitive), or -1 if the operand is not a register.
+int lookupRegister(std::string_view operand);
+
+// Parse a decimal or 0x-prefixed hex integer. Hex literals may use all 32
+// bits (0xFFFFFFFF parses as -1). Returns false on malformed input.
+bool parseInteger(std::string_view s, int32_t &value);
+
+void resolveAliases(ParsedLine &line);
 void resolveAliases(std::vector<ParsedLine> &lines);
-void expandPseudos(std::vector<ParsedLine> &lines);
+
+// True for mnemonics handled by expandPseudo (nop, move, li)
+bool isPseudo(std::string_view mnemonic);
+
+// Expand one line into `out`, returning how many lines were written (1 or
+// 2). Non-pseudo lines are copied through unchanged.
+size_t expandPseudo(const ParsedLine &line, ParsedLine out[2], SourceBuffer &source);
+// Expand every pseudo-instruction; returns how many were expanded.
+size_t expandPseudos(std::vector<ParsedLine> &lines, SourceBuffer &source);
 
 #endif
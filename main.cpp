@@ -1,16 +1,384 @@
-#include "assembler.h"
-#include <iostream>
-
-int main(int argc, char *argv[]) {
-    if (argc < 2) {
-        std::cerr << "Usage: " << argv[0] << " <input.txt>" << std::endl;
-        return 1;
-    }
-
-    if (!assemble(argv[1])) {
-        std::cerr << "Assembly failed." << std::endl;
-        return 1;
-    }
-
-    return 0;
-}
+#include "assembler.h"
+#include "parallel.h"
+#include "server.h"
+#include "error.h"
+#include "stats.h"
+#include <glob.h>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+
+static void usage(const char *prog) {
+    std::cerr << "Usage: " << prog << " [options] <input.txt>..." << std::endl;
+    std::cerr << "Inputs may also be given as @listfile (one path per line) or as"
+              << std::endl;
+    std::cerr << "quoted glob patterns such as 'src/*.s'." << std::endl;
+    std::cerr << "Options:" << std::endl;
+    std::cerr << "  --single-pass   encode while lexing, patching forward references"
+              << std::endl;
+    std::cerr << "  -O              shorten li, use addu for move, drop no-op instructions"
+              << std::endl;
+    std::cerr << "  --dce           delete unreachable code and unread ALU writes"
+              << std::endl;
+    std::cerr << "  --schedule      reorder to hide load-use stalls, fill delay slots"
+              << std::endl;
+    std::cerr << "  -c              write a relocatable object (.obj) per input" << std::endl;
+    std::cerr << "  --link          link the input objects into one image" << std::endl;
+    std::cerr << "  -o FILE         name of the linked image (default: first object's)"
+              << std::endl;
+    std::cerr << "  --run           execute the image in the built-in simulator" << std::endl;
+    std::cerr << "  --max-steps=N   stop the simulator after N instructions (default 1e8)"
+              << std::endl;
+    std::cerr << "  --profile-out=FILE" << std::endl;
+    std::cerr << "                  write the --run execution counts per word to FILE"
+              << std::endl;
+    std::cerr << "  --profile=FILE  lay out basic blocks by an execution profile" << std::endl;
+    std::cerr << "  --delay-slots   simulate branch delay slots" << std::endl;
+    std::cerr << "  --estimate      report static cycles per basic block and loop"
+              << std::endl;
+    std::cerr << "  --load-use-penalty=N, --branch-penalty=N" << std::endl;
+    std::cerr << "                  pipeline model for --estimate (default 1 each)"
+              << std::endl;
+    std::cerr << "  -j N            use N threads (-j 0: one per core); several inputs"
+              << std::endl;
+    std::cerr << "                  default to one per core" << std::endl;
+    std::cerr << "  --width=N       MIF word width in bits: 8, 16 or 32 (default 32)"
+              << std::endl;
+    std::cerr << "  --depth=N       MIF depth in words (default 256)" << std::endl;
+    std::cerr << "  --stats         print per-stage time, allocations and counts"
+              << std::endl;
+    std::cerr << "  --stats=FILE    write the same statistics as JSON to FILE"
+              << std::endl;
+    std::cerr << "  --format=F      output format: mif (default), bin, ihex, memh"
+              << std::endl;
+    std::cerr << "  --endian=E      byte order for bin and ihex: big (default), little"
+              << std::endl;
+    std::cerr << "  --cache-dir=D   reuse output of unchanged sources, stored in D"
+              << std::endl;
+    std::cerr << "  --cache-size=N  evict least recently used entries above N bytes"
+              << std::endl;
+    std::cerr << "                  (default 256 MiB)" << std::endl;
+    std::cerr << "  --max-errors=N  stop after N errors (default: no limit)" << std::endl;
+    std::cerr << "  --no-dedup      print every repeat of an identical message" << std::endl;
+    std::cerr << "  --diagnostics-json=FILE" << std::endl;
+    std::cerr << "                  also write errors and warnings as JSON to FILE"
+              << std::endl;
+    std::cerr << "  --serve         answer assembly requests on stdin/stdout" << std::endl;
+    std::cerr << "  --listen=PATH   answer assembly requests on a Unix socket" << std::endl;
+}
+
+// Parse the argument of -j; 0 means one thread per core
+static bool parseJobs(const char *s, unsigned &jobs) {
+    char *end = nullptr;
+    long n = std::strtol(s, &end, 10);
+    if (end == s || *end != '\0' || n < 0) return false;
+    jobs = n == 0 ? hardwareJobs() : static_cast<unsigned>(n);
+    return true;
+}
+
+// Parse a positive decimal (or 0x hex) count
+static bool parseCount(const char *s, unsigned long long &value) {
+    char *end = nullptr;
+    value = std::strtoull(s, &end, 0);
+    return end != s && *end == '\0' && value > 0;
+}
+
+// Parse a pipeline penalty in cycles; 0 is allowed
+static bool parsePenalty(const char *s, unsigned &cycles) {
+    char *end = nullptr;
+    unsigned long n = std::strtoul(s, &end, 10);
+    if (end == s || *end != '\0' || n > 1000) return false;
+    cycles = static_cast<unsigned>(n);
+    return true;
+}
+
+// Append `arg` to inputs, expanding glob patterns the shell left alone
+static bool addInput(const std::string &arg, std::vector<std::string> &inputs) {
+    if (arg.find_first_of("*?[") == std::string::npos) {
+        inputs.push_back(arg);
+        return true;
+    }
+
+    glob_t g;
+    int rc = glob(arg.c_str(), 0, nullptr, &g);
+    if (rc != 0) {
+        if (rc == GLOB_NOMATCH) {
+            std::cerr << "Error: no files match '" << arg << "'" << std::endl;
+        } else {
+            std::cerr << "Error: cannot expand '" << arg << "'" << std::endl;
+        }
+        if (rc != GLOB_NOSPACE) globfree(&g);
+        return false;
+    }
+    for (size_t i = 0; i < g.gl_pathc; i++) {
+        inputs.push_back(g.gl_pathv[i]);
+    }
+    globfree(&g);
+    return true;
+}
+
+// Read a response file: one input path or pattern per line, '#' comments
+static bool addResponseFile(const std::string &path, std::vector<std::string> &inputs) {
+    std::ifstream in(path);
+    if (!in.is_open()) {
+        std::cerr << "Error: cannot open response file '" << path << "'" << std::endl;
+        return false;
+    }
+    std::string line;
+    bool ok = true;
+    while (std::getline(in, line)) {
+        size_t hash = line.find('#');
+        if (hash != std::string::npos) line.erase(hash);
+        size_t start = line.find_first_not_of(" \t\r");
+        if (start == std::string::npos) continue;
+        size_t end = line.find_last_not_of(" \t\r");
+        ok &= addInput(line.substr(start, end - start + 1), inputs);
+    }
+    return ok;
+}
+
+int main(int argc, char *argv[]) {
+    AssemblerOptions options;
+    bool jobsGiven = false;
+    bool wantStats = false;
+    std::string statsFile;
+    std::vector<std::string> inputs;
+    std::string cacheDir;
+    unsigned long long cacheSize = 256ull << 20;
+    bool serve = false;
+    std::string socketPath;
+    std::string diagnosticsFile;
+    bool linkObjects = false;
+    std::string linkOutput;
+    // Repeated messages are summarized on the command line
+    options.diagnostics.dedup = true;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        if (std::strcmp(arg, "--no-dedup") == 0) {
+            options.diagnostics.dedup = false;
+        } else if (std::strcmp(arg, "--single-pass") == 0) {
+            options.singlePass = true;
+        } else if (std::strcmp(arg, "-O") == 0) {
+            options.optimize = true;
+        } else if (std::strcmp(arg, "--dce") == 0) {
+            options.deadCode = true;
+        } else if (std::strcmp(arg, "--schedule") == 0) {
+            options.schedule = true;
+        } else if (std::strcmp(arg, "-c") == 0) {
+            options.object = true;
+        } else if (std::strcmp(arg, "--link") == 0) {
+            linkObjects = true;
+        } else if (std::strcmp(arg, "-o") == 0) {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing file name for -o" << std::endl;
+                return 1;
+            }
+            linkOutput = argv[++i];
+        } else if (std::strcmp(arg, "--run") == 0) {
+            options.run = true;
+        } else if (std::strncmp(arg, "--max-steps=", 12) == 0) {
+            unsigned long long n;
+            if (!parseCount(arg + 12, n)) {
+                std::cerr << "Invalid step limit '" << (arg + 12) << "'" << std::endl;
+                return 1;
+            }
+            options.sim.maxSteps = n;
+        } else if (std::strncmp(arg, "--profile-out=", 14) == 0) {
+            options.profileOut = arg + 14;
+        } else if (std::strncmp(arg, "--profile=", 10) == 0) {
+            options.profile = arg + 10;
+        } else if (std::strcmp(arg, "--delay-slots") == 0) {
+            options.sim.delaySlots = true;
+            options.cost.delaySlots = true;
+        } else if (std::strcmp(arg, "--estimate") == 0) {
+            options.estimate = true;
+        } else if (std::strncmp(arg, "--load-use-penalty=", 19) == 0) {
+            if (!parsePenalty(arg + 19, options.cost.loadUsePenalty)) {
+                std::cerr << "Invalid load-use penalty '" << (arg + 19) << "'" << std::endl;
+                return 1;
+            }
+        } else if (std::strncmp(arg, "--branch-penalty=", 17) == 0) {
+            if (!parsePenalty(arg + 17, options.cost.branchPenalty)) {
+                std::cerr << "Invalid branch penalty '" << (arg + 17) << "'" << std::endl;
+                return 1;
+            }
+        } else if (std::strncmp(arg, "-j", 2) == 0) {
+            const char *value = arg[2] ? arg + 2 : (i + 1 < argc ? argv[++i] : "");
+            if (!parseJobs(value, options.jobs)) {
+                std::cerr << "Invalid job count for -j" << std::endl;
+                return 1;
+            }
+            jobsGiven = true;
+        } else if (std::strncmp(arg, "--width=", 8) == 0) {
+            unsigned long long n;
+            if (!parseCount(arg + 8, n) || (n != 8 && n != 16 && n != 32)) {
+                std::cerr << "Invalid MIF width '" << (arg + 8) << "'" << std::endl;
+                return 1;
+            }
+            options.output.mif.width = static_cast<unsigned>(n);
+        } else if (std::strncmp(arg, "--depth=", 8) == 0) {
+            unsigned long long n;
+            if (!parseCount(arg + 8, n)) {
+                std::cerr << "Invalid MIF depth '" << (arg + 8) << "'" << std::endl;
+                return 1;
+            }
+            options.output.mif.depth = static_cast<size_t>(n);
+        } else if (std::strcmp(arg, "--stats") == 0) {
+            wantStats = true;
+        } else if (std::strncmp(arg, "--stats=", 8) == 0) {
+            wantStats = true;
+            statsFile = arg + 8;
+        } else if (std::strncmp(arg, "--format=", 9) == 0) {
+            if (!parseOutputFormat(arg + 9, options.output.format)) {
+                std::cerr << "Unknown output format '" << (arg + 9) << "'" << std::endl;
+                return 1;
+            }
+        } else if (std::strncmp(arg, "--endian=", 9) == 0) {
+            if (std::strcmp(arg + 9, "big") == 0) {
+                options.output.endian = Endian::Big;
+            } else if (std::strcmp(arg + 9, "little") == 0) {
+                options.output.endian = Endian::Little;
+            } else {
+                std::cerr << "Unknown byte order '" << (arg + 9) << "'" << std::endl;
+                return 1;
+            }
+        } else if (std::strncmp(arg, "--cache-dir=", 12) == 0) {
+            cacheDir = arg + 12;
+        } else if (std::strncmp(arg, "--cache-size=", 13) == 0) {
+            if (!parseCount(arg + 13, cacheSize)) {
+                std::cerr << "Invalid cache size '" << (arg + 13) << "'" << std::endl;
+                return 1;
+            }
+        } else if (std::strncmp(arg, "--max-errors=", 13) == 0) {
+            unsigned long long n;
+            if (!parseCount(arg + 13, n) || n > 1000000000ull) {
+                std::cerr << "Invalid error limit '" << (arg + 13) << "'" << std::endl;
+                return 1;
+            }
+            options.diagnostics.maxErrors = static_cast<unsigned>(n);
+        } else if (std::strncmp(arg, "--diagnostics-json=", 19) == 0) {
+            diagnosticsFile = arg + 19;
+        } else if (std::strcmp(arg, "--serve") == 0) {
+            serve = true;
+        } else if (std::strncmp(arg, "--listen=", 9) == 0) {
+            socketPath = arg + 9;
+        } else if (arg[0] == '@') {
+            if (!addResponseFile(arg + 1, inputs)) return 1;
+        } else if (arg[0] == '-' && arg[1] != '\0') {
+            std::cerr << "Unknown option '" << arg << "'" << std::endl;
+            usage(argv[0]);
+            return 1;
+        } else {
+            if (!addInput(arg, inputs)) return 1;
+        }
+    }
+
+    // Server modes take their sources from requests
+    if (serve || !socketPath.empty()) {
+        if (!inputs.empty()) {
+            std::cerr << "Input files cannot be combined with --serve or --listen" << std::endl;
+            return 1;
+        }
+        if (!jobsGiven) options.jobs = hardwareJobs();
+        return serve ? serveStdio(options) : serveSocket(socketPath, options);
+    }
+
+    if (inputs.empty()) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (options.object && (linkObjects || options.run || options.estimate)) {
+        std::cerr << "-c cannot be combined with --link, --run or --estimate" << std::endl;
+        return 1;
+    }
+    if (!options.profileOut.empty() && !options.run) {
+        std::cerr << "--profile-out needs --run" << std::endl;
+        return 1;
+    }
+    if (!linkOutput.empty() && !linkObjects) {
+        std::cerr << "-o is only used with --link" << std::endl;
+        return 1;
+    }
+
+    if (wantStats) enableAllocationCounting();
+    if (!diagnosticsFile.empty()) collectDiagnosticsJson();
+    auto finishDiagnostics = [&]() {
+        if (!diagnosticsFile.empty()) writeDiagnosticsJson(diagnosticsFile);
+        flushDiagnostics();
+    };
+
+    // An unusable cache directory only costs speed, so carry on without it
+    std::unique_ptr<AssemblyCache> cache;
+    if (!cacheDir.empty()) {
+        cache = std::make_unique<AssemblyCache>(cacheDir, cacheSize);
+        if (cache->open()) {
+            options.cache = cache.get();
+        } else {
+            reportWarning(0, DiagCode::Io, "cannot use cache directory '" + cacheDir + "'");
+            cache.reset();
+        }
+    }
+    auto finishCache = [&]() {
+        if (!cache) return;
+        cache->trim();
+        reportInfo("Cache: " + std::to_string(cache->hits()) + " hits, " +
+                   std::to_string(cache->misses()) + " misses");
+    };
+
+    // Print the statistics table, or write them all as JSON
+    auto emitStats = [&](const std::vector<AssemblyStats> &runs) {
+        if (!statsFile.empty()) {
+            writeStatsJson(runs, statsFile);
+            return;
+        }
+        for (const auto &st : runs) {
+            if (runs.size() > 1) reportInfo(st.inputFile + ":");
+            reportStats(st);
+        }
+    };
+
+    // All inputs are objects, joined into one image
+    if (linkObjects) {
+        std::vector<AssemblyStats> runs(wantStats ? 1 : 0);
+        bool ok = link(inputs, linkOutput, options, wantStats ? &runs[0] : nullptr);
+        currentErrorContext().flush();
+        if (wantStats) emitStats(runs);
+        finishDiagnostics();
+        if (!ok) {
+            std::cerr << "Link failed." << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    if (inputs.size() == 1) {
+        std::vector<AssemblyStats> runs(wantStats ? 1 : 0);
+        bool ok = assemble(inputs[0], options, wantStats ? &runs[0] : nullptr);
+        currentErrorContext().flush();
+        if (wantStats) emitStats(runs);
+        finishCache();
+        finishDiagnostics();
+        if (!ok) {
+            std::cerr << "Assembly failed." << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    // Batch: exit status is the number of failed files (capped at 125)
+    if (!jobsGiven) options.jobs = hardwareJobs();
+    std::vector<AssemblyStats> runs;
+    int failures = assembleBatch(inputs, options, wantStats ? &runs : nullptr);
+    if (wantStats) emitStats(runs);
+    finishCache();
+    finishDiagnostics();
+    if (failures > 0) {
+        std::cerr << "Assembly failed for " << failures << " of "
+                  << inputs.size() << " files." << std::endl;
+        return failures > 125 ? 125 : failures;
+    }
+    return 0;
+}
@@ -0,0 +1,35 @@
+#include "mipsasm.h"
+#include "source.h"
+#include "symtab.h"
+
+AssemblyResult assembleText(std::string_view source, const AssemblerOptions &options) {
+    AssemblyResult result;
+
+    // Diagnostics go to a private context rather than the thread's own
+    ErrorContext errors(true);
+    ErrorScope scope(errors);
+    errors.setOptions(options.diagnostics);
+
+    SourceBuffer buffer;
+    buffer.borrow(source);
+    errors.setSource(buffer.text(), std::string());
+    std::vector<EncodedInst> encoded;
+    SymbolTable symbols;
+    DataImage data;
+    result.ok = assembleSource(buffer, options, encoded, nullptr, &symbols, &data);
+
+    if (result.ok) {
+        result.image.reserve(encoded.size());
+        for (const auto &inst : encoded) result.image.push_back(inst.word);
+        for (const Extent &e : data.extents()) {
+            result.data.push_back({e.address, std::string(e.bytes)});
+        }
+    }
+    for (uint32_t id = 0; id < symbols.size(); id++) {
+        if (!symbols.isDefined(id)) continue;
+        result.symbols.push_back({std::string(symbols.name(id)),
+                                  static_cast<uint32_t>(symbols.address(id))});
+    }
+    result.diagnostics = errors.diagnostics();
+    return result;
+}
@@ -0,0 +1,44 @@
+#ifndef MIPSASM_H
+#define MIPSASM_H
+
+// Library entry point (libmipsasm.a). Assembles a source held in memory
+// and returns everything in the result: nothing is written or printed,
+// and no state is shared between calls, so it can be called from several
+// threads at once. Only .incbin and options.profile read files.
+
+#include "assembler.h"
+#include "error.h"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct SymbolInfo {
+    std::string name;
+    uint32_t address;   // word address of an instruction, byte address of data
+};
+
+// Initialized bytes of the .data segment at one byte address
+struct DataBlock {
+    uint32_t address;
+    std::string bytes;
+};
+
+struct AssemblyResult {
+    bool ok = false;
+    std::vector<uint32_t> image;           // one word per instruction; empty on failure
+    std::vector<DataBlock> data;           // .data contents, by address; empty on failure
+    std::vector<SymbolInfo> symbols;       // defined labels, in order of first use
+    std::vector<Diagnostic> diagnostics;   // in report order; the optional passes
+                                           //   add Info summaries
+};
+
+// The options that apply are singlePass, jobs (the encode stage is split
+// across threads), optimize, deadCode, schedule, profile, sim.delaySlots
+// (slot filling, layout and the long form of relaxed branches) and
+// diagnostics (error cap and deduplication). Output, object, run,
+// estimate and cache settings are for file-based assembly.
+AssemblyResult assembleText(std::string_view source,
+                            const AssemblerOptions &options = AssemblerOptions());
+
+#endif
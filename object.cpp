@@ -0,0 +1,282 @@
+#include "object.h"
+#include "error.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+ObjectModule buildObject(const Program &program, const std::vector<Fixup> &fixups) {
+    if (!program.data.empty() || !program.dataLabels.empty()) {
+        int line = program.data.empty() ? program.dataLabels[0].lineNumber
+                                        : program.data[0].lineNumber;
+        reportError(line, DiagCode::WrongSegment, ".data is not supported in object files");
+    }
+
+    // Every symbol, so module symbol indices are the Program's IDs
+    ObjectModule module;
+    const SymbolTable &symbols = program.symbols;
+    module.symbols.resize(symbols.size());
+    for (uint32_t id = 0; id < symbols.size(); id++) {
+        module.symbols[id] = {symbols.name(id), symbols.address(id), 0, false};
+    }
+    for (const auto &label : program.labels) module.symbols[label.symbol].lineNumber = label.lineNumber;
+    for (const auto &global : program.globals) module.symbols[global.symbol].global = true;
+
+    // Branches only to imports: a branch within the module moves with it.
+    // Imports are text labels, so none can be a load or store offset.
+    for (const Fixup &f : fixups) {
+        if (f.pattern == OperandPattern::I_TMP_OFF_SRC) {
+            reportError(f.lineNumber, DiagCode::WrongSegment, "offset '" +
+                        std::string(symbols.name(f.symbol)) + "' is not a data label");
+            continue;
+        }
+        if (f.pattern != OperandPattern::I_SRC_TMP_LABEL) continue;
+        module.relocations.push_back({static_cast<uint32_t>(f.index), f.symbol,
+                                      RelocationKind::Branch, f.lineNumber});
+    }
+    const auto &insts = program.insts;
+    for (uint32_t i = 0; i < insts.size(); i++) {
+        if (!insts[i].lowered() || insts[i].def->pattern != OperandPattern::J_LABEL) continue;
+        const Operand &label = program.operandsOf(insts[i])[0];
+        module.relocations.push_back({i, label.value, RelocationKind::Jump, insts[i].lineNumber});
+    }
+    std::sort(module.relocations.begin(), module.relocations.end(),
+              [](const RelocationRecord &a, const RelocationRecord &b) { return a.index < b.index; });
+    return module;
+}
+
+template <typename T>
+static void appendRecords(std::string &out, const T *records, size_t count) {
+    out.append(reinterpret_cast<const char *>(records), count * sizeof(T));
+}
+
+bool writeObject(const std::vector<EncodedInst> &encoded, const ObjectModule &module,
+                 std::string_view sourceName, const std::string &path) {
+    std::string strings;
+    auto addString = [&](std::string_view s) {
+        ObjectLine ref{static_cast<uint32_t>(strings.size()), static_cast<uint32_t>(s.size())};
+        strings.append(s);
+        return ref;
+    };
+
+    ObjectHeader header{};
+    header.magic = OBJECT_MAGIC;
+    header.byteOrder = OBJECT_BYTE_ORDER;
+    header.version = OBJECT_VERSION;
+    header.wordCount = static_cast<uint32_t>(encoded.size());
+    header.symbolCount = static_cast<uint32_t>(module.symbols.size());
+    header.relocationCount = static_cast<uint32_t>(module.relocations.size());
+    ObjectLine source = addString(sourceName);
+    header.sourceOffset = source.offset;
+    header.sourceLength = source.length;
+
+    std::vector<uint32_t> words(encoded.size());
+    std::vector<ObjectLine> lines(encoded.size());
+    std::string_view previous;
+    for (size_t i = 0; i < encoded.size(); i++) {
+        words[i] = encoded[i].word;
+        // Words expanded from one line (li) share its text
+        std::string_view text = encoded[i].rawText;
+        if (i > 0 && text.data() == previous.data() && text.size() == previous.size()) {
+            lines[i] = lines[i - 1];
+        } else {
+            lines[i] = addString(text);
+        }
+        previous = text;
+    }
+
+    std::vector<ObjectSymbolRecord> symbols;
+    symbols.reserve(module.symbols.size());
+    for (const auto &s : module.symbols) {
+        symbols.push_back({addString(s.name), s.address, s.lineNumber,
+                           s.global ? SYMBOL_GLOBAL : 0u});
+    }
+    if (strings.size() > UINT32_MAX) {
+        reportError(0, DiagCode::BadObject, "object file '" + path + "' is too large");
+        return false;
+    }
+    header.stringBytes = static_cast<uint32_t>(strings.size());
+
+    std::string out;
+    out.reserve(sizeof(header) + words.size() * (sizeof(uint32_t) + sizeof(ObjectLine)) +
+                symbols.size() * sizeof(ObjectSymbolRecord) +
+                module.relocations.size() * sizeof(RelocationRecord) + strings.size());
+    appendRecords(out, &header, 1);
+    appendRecords(out, words.data(), words.size());
+    appendRecords(out, lines.data(), lines.size());
+    appendRecords(out, symbols.data(), symbols.size());
+    appendRecords(out, module.relocations.data(), module.relocations.size());
+    out += strings;
+
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        reportError(0, DiagCode::Io, "cannot open output file '" + path + "'");
+        return false;
+    }
+    const char *p = out.data();
+    size_t left = out.size();
+    bool ok = true;
+    while (left > 0) {
+        ssize_t n = ::write(fd, p, left);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            ok = false;
+            break;
+        }
+        p += n;
+        left -= static_cast<size_t>(n);
+    }
+    ok &= ::close(fd) == 0;
+    if (!ok) reportError(0, DiagCode::Io, "failed writing output file '" + path + "'");
+    return ok;
+}
+
+bool ObjectFile::open(const std::string &path) {
+    path_ = path;
+    if (!buffer_.open(path)) {
+        reportError(0, DiagCode::Io, "cannot open object file '" + path + "'");
+        return false;
+    }
+    std::string_view bytes = buffer_.text();
+    auto invalid = [&](const std::string &why) {
+        reportError(0, DiagCode::BadObject,
+                    "'" + path + "' is not a valid object file (" + why + ")");
+        return false;
+    };
+
+    if (bytes.size() < sizeof(ObjectHeader)) return invalid("truncated");
+    std::memcpy(&header_, bytes.data(), sizeof(header_));
+    if (header_.magic != OBJECT_MAGIC) return invalid("bad magic number");
+    if (header_.byteOrder != OBJECT_BYTE_ORDER) return invalid("other byte order");
+    if (header_.version != OBJECT_VERSION) {
+        return invalid("version " + std::to_string(header_.version));
+    }
+    uint64_t size = sizeof(ObjectHeader) +
+                    uint64_t(header_.wordCount) * (sizeof(uint32_t) + sizeof(ObjectLine)) +
+                    uint64_t(header_.symbolCount) * sizeof(ObjectSymbolRecord) +
+                    uint64_t(header_.relocationCount) * sizeof(RelocationRecord) +
+                    header_.stringBytes;
+    if (size != bytes.size()) return invalid("size does not match header");
+
+    // The mapping is page aligned and every record a multiple of 4 bytes
+    const char *p = bytes.data() + sizeof(ObjectHeader);
+    words_ = reinterpret_cast<const uint32_t *>(p);
+    p += header_.wordCount * sizeof(uint32_t);
+    lines_ = reinterpret_cast<const ObjectLine *>(p);
+    p += header_.wordCount * sizeof(ObjectLine);
+    symbols_ = reinterpret_cast<const ObjectSymbolRecord *>(p);
+    p += header_.symbolCount * sizeof(ObjectSymbolRecord);
+    relocations_ = reinterpret_cast<const RelocationRecord *>(p);
+    p += header_.relocationCount * sizeof(RelocationRecord);
+    strings_ = p;
+
+    auto inStrings = [&](ObjectLine s) {
+        return uint64_t(s.offset) + s.length <= header_.stringBytes;
+    };
+    if (!inStrings({header_.sourceOffset, header_.sourceLength})) return invalid("bad source name");
+    for (uint32_t i = 0; i < header_.wordCount; i++) {
+        if (!inStrings(lines_[i])) return invalid("bad line text");
+    }
+    for (uint32_t i = 0; i < header_.symbolCount; i++) {
+        const ObjectSymbolRecord &s = symbols_[i];
+        if (!inStrings(s.name)) return invalid("bad symbol name");
+        if (s.address < SymbolTable::UNDEFINED ||
+            (s.address >= 0 && static_cast<uint32_t>(s.address) > header_.wordCount)) {
+            return invalid("bad symbol address");
+        }
+    }
+    for (uint32_t i = 0; i < header_.relocationCount; i++) {
+        const RelocationRecord &r = relocations_[i];
+        if (r.index >= header_.wordCount || r.symbol >= header_.symbolCount ||
+            (r.kind != RelocationKind::Branch && r.kind != RelocationKind::Jump)) {
+            return invalid("bad relocation");
+        }
+    }
+    return true;
+}
+
+bool linkObjects(const std::vector<const ObjectFile *> &objects,
+                 std::vector<EncodedInst> &image, SymbolTable &globals) {
+    // Diagnostics name each module's source
+    ErrorContext &errors = currentErrorContext();
+    std::string previousFile = errors.file();
+    auto inModule = [&](const ObjectFile &object) {
+        errors.setFile(std::string(object.sourceName()));
+    };
+
+    std::vector<uint32_t> base(objects.size());
+    uint64_t total = 0;
+    for (size_t m = 0; m < objects.size(); m++) {
+        base[m] = static_cast<uint32_t>(total);
+        total += objects[m]->wordCount();
+    }
+    if (total > (1ull << 30)) {
+        reportError(0, DiagCode::ImageTooLarge, "program needs " + std::to_string(total) +
+                    " words, more than the 32-bit address space holds");
+        return false;
+    }
+
+    // Exports first, so a module may use the globals of any other
+    std::vector<uint32_t> owner;   // per global, module that defines it
+    for (size_t m = 0; m < objects.size(); m++) {
+        const ObjectFile &object = *objects[m];
+        for (uint32_t s = 0; s < object.symbolCount(); s++) {
+            const ObjectSymbolRecord &sym = object.symbol(s);
+            if (!(sym.flags & SYMBOL_GLOBAL) || sym.address < 0) continue;
+            uint32_t id = globals.intern(object.symbolName(s));
+            if (owner.size() < globals.size()) owner.resize(globals.size());
+            if (globals.isDefined(id)) {
+                inModule(object);
+                reportError(sym.lineNumber, DiagCode::DuplicateLabel, "duplicate label '" +
+                            std::string(object.symbolName(s)) + "' (also defined in " +
+                            std::string(objects[owner[id]]->sourceName()) + ")");
+                continue;
+            }
+            globals.define(id, static_cast<int>(base[m]) + sym.address);
+            owner[id] = static_cast<uint32_t>(m);
+        }
+    }
+
+    image.clear();
+    image.reserve(total);
+    for (size_t m = 0; m < objects.size() && !errorLimitReached(); m++) {
+        const ObjectFile &object = *objects[m];
+        inModule(object);
+        const uint32_t *words = object.words();
+        for (uint32_t w = 0; w < object.wordCount(); w++) {
+            image.push_back({words[w], object.lineText(w)});
+        }
+
+        int moduleBase = static_cast<int>(base[m]);
+        for (uint32_t r = 0; r < object.relocationCount() && !errorLimitReached(); r++) {
+            const RelocationRecord &reloc = object.relocation(r);
+            const ObjectSymbolRecord &sym = object.symbol(reloc.symbol);
+            std::string_view name = object.symbolName(reloc.symbol);
+            int target;
+            if (sym.address >= 0) {
+                target = moduleBase + sym.address;
+            } else {
+                uint32_t id = globals.find(name);
+                if (id == SymbolTable::NONE || !globals.isDefined(id)) {
+                    reportError(reloc.lineNumber, DiagCode::UndefinedLabel, "undefined label '" +
+                                std::string(name) + "'");
+                    continue;
+                }
+                target = globals.address(id);
+            }
+
+            OperandPattern pattern = reloc.kind == RelocationKind::Jump
+                                         ? OperandPattern::J_LABEL
+                                         : OperandPattern::I_SRC_TMP_LABEL;
+            int address = moduleBase + static_cast<int>(reloc.index);
+            if (!labelInRange(pattern, target, address)) {
+                reportOutOfRange(pattern, target, address, reloc.lineNumber, name);
+            }
+            uint32_t &word = image[address].word;
+            word = patchLabelField(word, pattern, target, address);
+        }
+    }
+    errors.setFile(previousFile);
+    return !hasErrors();
+}
@@ -0,0 +1,144 @@
+#ifndef OBJECT_H
+#define OBJECT_H
+
+#include "encoder.h"
+#include "ir.h"
+#include "source.h"
+#include "symtab.h"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Relocatable object files (-c) and the link step that joins them.
+//
+// An object holds one module's encoded text, assembled at address 0, with
+// its labels and one relocation per word whose label field depends on
+// where the module lands or on another module: every j/jal (the field is
+// an absolute word address) and every beq/bne to a label the module does
+// not define. Labels are local unless named by .globl; labels used but
+// not defined are imports, resolved against the other modules' globals.
+//
+// On disk: an ObjectHeader, then the arrays below in this order, each
+// record four-byte aligned and in host byte order, so a loaded object is
+// used straight from its mapping:
+//     uint32_t          words[wordCount]
+//     ObjectLine        lines[wordCount]
+//     ObjectSymbolRecord symbols[symbolCount]
+//     RelocationRecord  relocations[relocationCount]
+//     char              strings[stringBytes]   (names and line text)
+
+constexpr uint32_t OBJECT_MAGIC = 0x4A424F4Du;      // "MOBJ" little-endian
+constexpr uint32_t OBJECT_BYTE_ORDER = 0x01020304u;  // reads differently if swapped
+constexpr uint32_t OBJECT_VERSION = 1;
+
+struct ObjectHeader {
+    uint32_t magic;
+    uint32_t byteOrder;
+    uint32_t version;
+    uint32_t wordCount;
+    uint32_t symbolCount;
+    uint32_t relocationCount;
+    uint32_t stringBytes;
+    uint32_t sourceOffset;   // source file name, for link diagnostics
+    uint32_t sourceLength;
+};
+
+// A string in the string table
+struct ObjectLine {
+    uint32_t offset;
+    uint32_t length;
+};
+
+struct ObjectSymbolRecord {
+    ObjectLine name;
+    int32_t address;     // word address in the module, or -1 for an import
+    int32_t lineNumber;  // of the definition, or 0
+    uint32_t flags;      // SYMBOL_GLOBAL
+};
+
+constexpr uint32_t SYMBOL_GLOBAL = 1;
+
+enum class RelocationKind : uint32_t {
+    Branch = 0,   // 16-bit offset of beq/bne
+    Jump = 1,     // 26-bit word address of j/jal
+};
+
+struct RelocationRecord {
+    uint32_t index;       // word to patch
+    uint32_t symbol;      // index into the symbols
+    RelocationKind kind;
+    int32_t lineNumber;   // of the instruction
+};
+
+// A module ready to be written: the symbols and relocations of an
+// assembled Program. Names are views into the source.
+struct ObjectModule {
+    struct Symbol {
+        std::string_view name;
+        int address;      // SymbolTable::UNDEFINED for an import
+        int lineNumber;
+        bool global;
+    };
+
+    std::vector<Symbol> symbols;            // indexed by the Program's symbol IDs
+    std::vector<RelocationRecord> relocations;   // in word order
+};
+
+// Collect the symbols and relocations of `program`, encoded with its
+// undefined labels left as `fixups` (see encode()). Reports .data, which
+// objects do not carry.
+ObjectModule buildObject(const Program &program, const std::vector<Fixup> &fixups);
+
+// Write `encoded` and `module` as an object file, in one write.
+bool writeObject(const std::vector<EncodedInst> &encoded, const ObjectModule &module,
+                 std::string_view sourceName, const std::string &path);
+
+// A mapped object file. Everything returned points into the mapping.
+class ObjectFile {
+public:
+    // Map `path` and check that every count, offset and index stays inside
+    // it. Reports and returns false if it cannot be read or is not an
+    // object file.
+    bool open(const std::string &path);
+
+    const std::string &path() const { return path_; }
+    std::string_view sourceName() const { return string(header_.sourceOffset, header_.sourceLength); }
+
+    uint32_t wordCount() const { return header_.wordCount; }
+    const uint32_t *words() const { return words_; }
+    std::string_view lineText(uint32_t i) const { return string(lines_[i].offset, lines_[i].length); }
+
+    uint32_t symbolCount() const { return header_.symbolCount; }
+    const ObjectSymbolRecord &symbol(uint32_t i) const { return symbols_[i]; }
+    std::string_view symbolName(uint32_t i) const {
+        return string(symbols_[i].name.offset, symbols_[i].name.length);
+    }
+
+    uint32_t relocationCount() const { return header_.relocationCount; }
+    const RelocationRecord &relocation(uint32_t i) const { return relocations_[i]; }
+
+private:
+    std::string_view string(uint32_t offset, uint32_t length) const {
+        return std::string_view(strings_ + offset, length);
+    }
+
+    std::string path_;
+    SourceBuffer buffer_;
+    ObjectHeader header_{};
+    const uint32_t *words_ = nullptr;
+    const ObjectLine *lines_ = nullptr;
+    const ObjectSymbolRecord *symbols_ = nullptr;
+    const RelocationRecord *relocations_ = nullptr;
+    const char *strings_ = nullptr;
+};
+
+// Place the modules one after another in the given order, bind every
+// global, and patch each relocation. Reports duplicate globals, imports
+// no module exports, and branches or jumps that cannot reach their label,
+// each against the module's source. `image` gets the linked words (their
+// text views into the objects) and `globals` every exported label.
+bool linkObjects(const std::vector<const ObjectFile *> &objects,
+                 std::vector<EncodedInst> &image, SymbolTable &globals);
+
+#endif
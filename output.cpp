@@ -0,0 +1,448 @@
+#include "output.h"
+#include "error.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <string_view>
+
+static const char HEX_UPPER[] = "0123456789ABCDEF";
+static const char HEX_LOWER[] = "0123456789abcdef";
+
+// Output is formatted into one buffer and handed to the OS in large blocks
+static const size_t FLUSH_THRESHOLD = 1 << 20;
+
+namespace {
+
+class BlockWriter {
+public:
+    explicit BlockWriter(std::FILE *f) : file_(f) { buf_.reserve(FLUSH_THRESHOLD + 4096); }
+
+    void put(std::string_view s) { buf_.append(s.data(), s.size()); }
+    void put(char c) { buf_.push_back(c); }
+
+    // `digits` hex digits of value, zero-padded
+    void hex(uint64_t value, unsigned digits, const char *alphabet) {
+        char tmp[16];
+        for (unsigned i = digits; i-- > 0;) {
+            tmp[i] = alphabet[value & 0xF];
+            value >>= 4;
+        }
+        buf_.append(tmp, digits);
+    }
+
+    void endLine() {
+        buf_.push_back('\n');
+        if (buf_.size() >= FLUSH_THRESHOLD) flush();
+    }
+
+    bool flush() {
+        if (!buf_.empty() &&
+            std::fwrite(buf_.data(), 1, buf_.size(), file_) != buf_.size()) {
+            ok_ = false;
+        }
+        buf_.clear();
+        return ok_;
+    }
+
+private:
+    std::FILE *file_;
+    std::string buf_;
+    bool ok_ = true;
+};
+
+} // namespace
+
+static unsigned hexDigitsFor(uint64_t maxValue) {
+    unsigned digits = 1;
+    while (maxValue >>= 4) digits++;
+    return digits;
+}
+
+namespace {
+
+// Consecutive populated words of the image: the text, or data packed
+// big-endian from one or more extents that share or touch words.
+struct WordSpan {
+    uint64_t first;                  // word address
+    uint64_t count;
+    const EncodedInst *text;         // text words, or null for data
+    std::vector<uint32_t> words;     // data words
+
+    uint32_t word(uint64_t i) const { return text ? text[i].word : words[i]; }
+    std::string_view comment(uint64_t i) const {
+        return text ? text[i].rawText : std::string_view();
+    }
+    uint64_t end() const { return first + count; }
+};
+
+} // namespace
+
+// The text at word 0 followed by the data extents, in address order.
+// Holes between spans read as zero.
+static std::vector<WordSpan> imageSpans(const std::vector<EncodedInst> &encoded,
+                                        const DataImage *data) {
+    std::vector<WordSpan> spans;
+    if (!encoded.empty()) spans.push_back({0, encoded.size(), encoded.data(), {}});
+    if (!data || data->empty()) return spans;
+
+    std::vector<Extent> extents = data->extents();
+    size_t firstData = spans.size();
+    for (const Extent &e : extents) {
+        uint64_t begin = e.address / 4;
+        uint64_t end = (static_cast<uint64_t>(e.address) + e.bytes.size() + 3) / 4;
+        if (spans.size() > firstData && begin <= spans.back().end()) {
+            spans.back().count = std::max(spans.back().end(), end) - spans.back().first;
+        } else {
+            spans.push_back({begin, end - begin, nullptr, {}});
+        }
+    }
+    size_t s = firstData;
+    for (size_t i = firstData; i < spans.size(); i++) {
+        spans[i].words.assign(spans[i].count, 0);
+    }
+    for (const Extent &e : extents) {
+        while (spans[s].end() * 4 <= e.address) s++;
+        WordSpan &span = spans[s];
+        uint64_t addr = e.address - span.first * 4;
+        for (unsigned char c : e.bytes) {
+            span.words[addr / 4] |= static_cast<uint32_t>(c) << (8 * (3 - addr % 4));
+            addr++;
+        }
+    }
+    return spans;
+}
+
+bool writeMIF(const std::vector<EncodedInst> &encoded,
+              const std::string &outFile,
+              const MifOptions &options,
+              const DataImage *data) {
+    unsigned width = options.width;
+    if (width != 8 && width != 16 && width != 32) {
+        reportError(0, DiagCode::BadOption, "unsupported MIF width " + std::to_string(width) +
+                    " (expected 8, 16 or 32)");
+        return false;
+    }
+    unsigned perWord = 32 / width;   // memory entries per instruction
+    std::vector<WordSpan> spans = imageSpans(encoded, data);
+    uint64_t used = spans.empty() ? 0 : spans.back().end() * perWord;
+    uint64_t depth = options.depth;
+    if (depth == 0 || used > depth) {
+        reportError(0, DiagCode::ImageTooLarge, "program needs " + std::to_string(used) +
+                    " memory words but DEPTH is " + std::to_string(depth));
+        return false;
+    }
+
+    std::FILE *f = std::fopen(outFile.c_str(), "wb");
+    if (!f) {
+        reportError(0, DiagCode::Io, "cannot open output file '" + outFile + "'");
+        return false;
+    }
+
+    unsigned addrDigits = std::max(3u, hexDigitsFor(depth - 1));
+    unsigned dataDigits = width / 4;
+    uint32_t mask = width == 32 ? 0xFFFFFFFFu : ((1u << width) - 1);
+
+    BlockWriter out(f);
+    out.put("WIDTH=" + std::to_string(width) + ";\n");
+    out.put("DEPTH=" + std::to_string(depth) + ";\n");
+    out.put("\nADDRESS_RADIX=HEX;\nDATA_RADIX=HEX;\n\nCONTENT BEGIN\n");
+
+    auto entry = [&](uint64_t a, uint32_t value, std::string_view comment) {
+        out.put("   ");
+        out.hex(a, addrDigits, HEX_LOWER);
+        out.put("  :   ");
+        out.hex(value, dataDigits, HEX_UPPER);
+        out.put(';');
+        if (!comment.empty()) {
+            out.put("  -- ");
+            out.put(comment);
+        }
+        out.endLine();
+    };
+    auto range = [&](uint64_t first, uint64_t last, uint32_t value,
+                     std::string_view comment) {
+        out.put("   [");
+        out.hex(first, addrDigits, HEX_LOWER);
+        out.put("..");
+        out.hex(last, addrDigits, HEX_LOWER);
+        out.put("]  :   ");
+        out.hex(value, dataDigits, HEX_UPPER);
+        out.put(';');
+        if (!comment.empty()) {
+            out.put("  -- ");
+            out.put(comment);
+        }
+        out.endLine();
+    };
+
+    uint64_t a = 0;
+    for (size_t s = 0; s < spans.size(); s++) {
+        const WordSpan &span = spans[s];
+        uint64_t base = span.first * perWord;
+        uint64_t spanEnd = span.end() * perWord;
+        // A trailing run of zeros extends over the hole to the next span
+        uint64_t limit = s + 1 < spans.size() ? spans[s + 1].first * perWord : depth;
+
+        // Memory entry `a` of the span: its value and source comment
+        auto valueAt = [&](uint64_t a) -> uint32_t {
+            uint32_t word = span.word((a - base) / perWord);
+            unsigned shift = width * (perWord - 1 - static_cast<unsigned>(a % perWord));
+            return (word >> shift) & mask;
+        };
+        auto commentAt = [&](uint64_t a) -> std::string_view {
+            // Only the first entry of a split instruction carries its source
+            return a % perWord == 0 ? span.comment((a - base) / perWord) : std::string_view();
+        };
+
+        if (a + 1 == base) {
+            entry(a, 0, std::string_view());
+        } else if (a < base) {
+            range(a, base - 1, 0, std::string_view());
+        }
+        a = std::max(a, base);
+        while (a < spanEnd) {
+            uint32_t value = valueAt(a);
+            std::string_view comment = commentAt(a);
+            bool sameComment = true;
+
+            // Extend over identical words; the padding joins a trailing run of zeros
+            uint64_t end = a + 1;
+            while (end < spanEnd && valueAt(end) == value) {
+                sameComment &= commentAt(end) == comment;
+                end++;
+            }
+            if (end == spanEnd && value == 0 && spanEnd < limit) {
+                end = limit;
+                sameComment = false;
+            }
+
+            if (end - a == 1) {
+                entry(a, value, comment);
+            } else {
+                range(a, end - 1, value, sameComment ? comment : std::string_view());
+            }
+            a = end;
+        }
+    }
+
+    // Zero padding up to DEPTH is always written as a range
+    if (a < depth) {
+        range(a, depth - 1, 0, std::string_view());
+    }
+
+    out.put("\nEND;");
+    bool ok = out.flush();
+    ok &= std::fclose(f) == 0;
+    if (!ok) {
+        reportError(0, DiagCode::Io, "failed writing output file '" + outFile + "'");
+    }
+    return ok;
+}
+
+// Write `size` bytes at `offset` with as few pwrite() calls as the kernel
+// allows. Skipped ranges of the file stay holes.
+static bool writeAt(int fd, uint64_t offset, const void *data, size_t size) {
+    const char *p = static_cast<const char *>(data);
+    while (size > 0) {
+        ssize_t n = ::pwrite(fd, p, size, static_cast<off_t>(offset));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        p += n;
+        offset += static_cast<uint64_t>(n);
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+static void storeWord(uint8_t *dst, uint32_t word, Endian endian) {
+    if (endian == Endian::Big) {
+        dst[0] = static_cast<uint8_t>(word >> 24);
+        dst[1] = static_cast<uint8_t>(word >> 16);
+        dst[2] = static_cast<uint8_t>(word >> 8);
+        dst[3] = static_cast<uint8_t>(word);
+    } else {
+        dst[0] = static_cast<uint8_t>(word);
+        dst[1] = static_cast<uint8_t>(word >> 8);
+        dst[2] = static_cast<uint8_t>(word >> 16);
+        dst[3] = static_cast<uint8_t>(word >> 24);
+    }
+}
+
+namespace {
+
+class MifWriter : public ImageWriter {
+public:
+    explicit MifWriter(const MifOptions &options) : options_(options) {}
+    const char *extension() const override { return ".mif"; }
+    bool write(const std::vector<EncodedInst> &encoded, const DataImage &data,
+               const std::string &outFile) const override {
+        return writeMIF(encoded, outFile, options_, &data);
+    }
+
+private:
+    MifOptions options_;
+};
+
+// Raw image: 4 bytes per word, no header, so a testbench can mmap it and
+// index words directly. Gaps in a sparse image are left as file holes.
+class BinaryWriter : public ImageWriter {
+public:
+    explicit BinaryWriter(Endian endian) : endian_(endian) {}
+    const char *extension() const override { return ".bin"; }
+    bool write(const std::vector<EncodedInst> &encoded, const DataImage &data,
+               const std::string &outFile) const override {
+        int fd = ::open(outFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            reportError(0, DiagCode::Io, "cannot open output file '" + outFile + "'");
+            return false;
+        }
+        bool ok = true;
+        std::vector<uint8_t> bytes;
+        for (const WordSpan &span : imageSpans(encoded, &data)) {
+            bytes.resize(span.count * 4);
+            for (uint64_t i = 0; i < span.count; i++) {
+                storeWord(&bytes[i * 4], span.word(i), endian_);
+            }
+            ok = ok && writeAt(fd, span.first * 4, bytes.data(), bytes.size());
+        }
+        ok &= ::close(fd) == 0;
+        if (!ok) {
+            reportError(0, DiagCode::Io, "failed writing output file '" + outFile + "'");
+        }
+        return ok;
+    }
+
+private:
+    Endian endian_;
+};
+
+// Intel HEX: 16-byte data records, extended linear address records past
+// 64 KB, and an end-of-file record. Gaps in a sparse image get no records.
+class IntelHexWriter : public ImageWriter {
+public:
+    explicit IntelHexWriter(Endian endian) : endian_(endian) {}
+    const char *extension() const override { return ".hex"; }
+    bool write(const std::vector<EncodedInst> &encoded, const DataImage &data,
+               const std::string &outFile) const override {
+        std::FILE *f = std::fopen(outFile.c_str(), "wb");
+        if (!f) {
+            reportError(0, DiagCode::Io, "cannot open output file '" + outFile + "'");
+            return false;
+        }
+
+        BlockWriter out(f);
+        auto record = [&](uint8_t type, uint16_t offset,
+                          const uint8_t *data, size_t len) {
+            uint8_t sum = static_cast<uint8_t>(len + (offset >> 8) + (offset & 0xFF) + type);
+            out.put(':');
+            out.hex(len, 2, HEX_UPPER);
+            out.hex(offset, 4, HEX_UPPER);
+            out.hex(type, 2, HEX_UPPER);
+            for (size_t i = 0; i < len; i++) {
+                out.hex(data[i], 2, HEX_UPPER);
+                sum = static_cast<uint8_t>(sum + data[i]);
+            }
+            out.hex(static_cast<uint8_t>(-sum), 2, HEX_UPPER);
+            out.endLine();
+        };
+
+        const size_t RECORD_BYTES = 16;
+        uint8_t bytes[RECORD_BYTES];
+        uint32_t upper = 0;
+
+        for (const WordSpan &span : imageSpans(encoded, &data)) {
+            uint64_t begin = span.first * 4, total = span.end() * 4;
+            for (uint64_t addr = begin; addr < total;) {
+                uint32_t high = static_cast<uint32_t>(addr >> 16);
+                if (high != upper) {
+                    uint8_t ext[2] = {static_cast<uint8_t>(high >> 8),
+                                      static_cast<uint8_t>(high)};
+                    record(0x04, 0, ext, 2);
+                    upper = high;
+                }
+                // Records never cross a 64 KB boundary
+                size_t len = static_cast<size_t>(std::min<uint64_t>(
+                    {RECORD_BYTES, total - addr, 0x10000 - (addr & 0xFFFF)}));
+                for (size_t i = 0; i < len; i += 4) {
+                    storeWord(&bytes[i], span.word((addr + i) / 4 - span.first), endian_);
+                }
+                record(0x00, static_cast<uint16_t>(addr & 0xFFFF), bytes, len);
+                addr += len;
+            }
+        }
+        record(0x01, 0, nullptr, 0);
+
+        bool ok = out.flush();
+        ok &= std::fclose(f) == 0;
+        if (!ok) {
+            reportError(0, DiagCode::Io, "failed writing output file '" + outFile + "'");
+        }
+        return ok;
+    }
+
+private:
+    Endian endian_;
+};
+
+// $readmemh text: one 8-digit word per line, starting at address 0. Each
+// span of a sparse image after the first starts with an @address line.
+class ReadMemHWriter : public ImageWriter {
+public:
+    const char *extension() const override { return ".mem"; }
+    bool write(const std::vector<EncodedInst> &encoded, const DataImage &data,
+               const std::string &outFile) const override {
+        std::FILE *f = std::fopen(outFile.c_str(), "wb");
+        if (!f) {
+            reportError(0, DiagCode::Io, "cannot open output file '" + outFile + "'");
+            return false;
+        }
+
+        BlockWriter out(f);
+        uint64_t next = 0;
+        for (const WordSpan &span : imageSpans(encoded, &data)) {
+            if (span.first != next) {
+                out.put('@');
+                out.hex(span.first, 8, HEX_UPPER);
+                out.endLine();
+            }
+            for (uint64_t i = 0; i < span.count; i++) {
+                out.hex(span.word(i), 8, HEX_UPPER);
+                out.endLine();
+            }
+            next = span.end();
+        }
+
+        bool ok = out.flush();
+        ok &= std::fclose(f) == 0;
+        if (!ok) {
+            reportError(0, DiagCode::Io, "failed writing output file '" + outFile + "'");
+        }
+        return ok;
+    }
+};
+
+} // namespace
+
+std::unique_ptr<ImageWriter> makeImageWriter(const OutputOptions &options) {
+    switch (options.format) {
+        case OutputFormat::Mif:      return std::make_unique<MifWriter>(options.mif);
+        case OutputFormat::Binary:   return std::make_unique<BinaryWriter>(options.endian);
+        case OutputFormat::IntelHex: return std::make_unique<IntelHexWriter>(options.endian);
+        case OutputFormat::ReadMemH: return std::make_unique<ReadMemHWriter>();
+    }
+    return nullptr;
+}
+
+bool parseOutputFormat(const std::string &name, OutputFormat &format) {
+    if (name == "mif")       format = OutputFormat::Mif;
+    else if (name == "bin")  format = OutputFormat::Binary;
+    else if (name == "ihex") format = OutputFormat::IntelHex;
+    else if (name == "memh") format = OutputFormat::ReadMemH;
+    else return false;
+    return true;
+}
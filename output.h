@@ -0,0 +1,64 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include "data.h"
+#include "encoder.h"
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+enum class OutputFormat {
+    Mif,        // Quartus Memory Initialization File
+    Binary,     // raw 32-bit words, one write, loadable with mmap
+    IntelHex,   // Intel HEX records with byte addresses
+    ReadMemH,   // one hex word per line, for Verilog $readmemh
+};
+
+enum class Endian {
+    Big,
+    Little,
+};
+
+struct MifOptions {
+    unsigned width = 32;   // bits per memory word: 8, 16 or 32
+    size_t depth = 256;    // number of memory words
+};
+
+// Write a MIF image. Instruction words are split big-endian when the memory
+// is narrower than 32 bits. Runs of identical words, including the padding
+// up to `depth` and the gaps of a sparse image, are written as
+// "[aaa..bbb]" ranges. The .data segment in `data`, if given, is placed
+// at its byte addresses (word address * 4). Fails with an error if the
+// image does not fit in the memory.
+bool writeMIF(const std::vector<EncodedInst> &encoded,
+              const std::string &outFile,
+              const MifOptions &options = MifOptions(),
+              const DataImage *data = nullptr);
+
+struct OutputOptions {
+    OutputFormat format = OutputFormat::Mif;
+    Endian endian = Endian::Big;   // byte order for Binary and IntelHex
+    MifOptions mif;
+};
+
+// One output backend. Every backend writes the same encode() result at
+// word 0 and the .data segment at its byte addresses; they differ only in
+// container format.
+class ImageWriter {
+public:
+    virtual ~ImageWriter() = default;
+
+    // Extension of the output file, including the dot (e.g. ".mif")
+    virtual const char *extension() const = 0;
+
+    virtual bool write(const std::vector<EncodedInst> &encoded, const DataImage &data,
+                       const std::string &outFile) const = 0;
+};
+
+std::unique_ptr<ImageWriter> makeImageWriter(const OutputOptions &options);
+
+// Parse a --format name ("mif", "bin", "ihex", "memh"); false if unknown.
+bool parseOutputFormat(const std::string &name, OutputFormat &format);
+
+#endif
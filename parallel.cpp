@@ -0,0 +1,138 @@
+#include "parallel.h"
+#include <algorithm>
+
+unsigned hardwareJobs() {
+    unsigned n = std::thread::hardware_concurrency();
+    return n == 0 ? 1 : n;
+}
+
+void parallelFor(size_t count, unsigned jobs,
+                 const std::function<void(size_t)> &task) {
+    if (count == 0) return;
+    size_t threads = std::min<size_t>(std::max(jobs, 1u), count);
+
+    std::atomic<size_t> next{0};
+    auto worker = [&]() {
+        for (size_t i = next++; i < count; i = next++) {
+            task(i);
+        }
+    };
+
+    std::vector<std::thread> pool;
+    pool.reserve(threads - 1);
+    for (size_t t = 1; t < threads; t++) {
+        pool.emplace_back(worker);
+    }
+    worker();
+    for (auto &th : pool) {
+        th.join();
+    }
+}
+
+// Index of the pool worker running on this thread, or SIZE_MAX elsewhere
+static thread_local const WorkStealingPool *t_pool = nullptr;
+static thread_local size_t t_workerIndex = SIZE_MAX;
+
+WorkStealingPool::WorkStealingPool(unsigned threads) {
+    size_t n = std::max(threads, 1u);
+    for (size_t i = 0; i < n; i++) {
+        queues_.push_back(std::make_unique<Queue>());
+    }
+    for (size_t i = 0; i < n; i++) {
+        workers_.emplace_back([this, i]() { run(i); });
+    }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    wait();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    for (auto &t : workers_) {
+        t.join();
+    }
+}
+
+void WorkStealingPool::submit(std::function<void()> task) {
+    bool nested = t_pool == this;
+    size_t q = nested ? t_workerIndex : nextQueue_++ % queues_.size();
+    // Count the task before it becomes visible, so a worker can never
+    // retire it before it is counted
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queued_++;
+        unfinished_++;
+    }
+    {
+        std::lock_guard<std::mutex> lock(queues_[q]->mutex);
+        queues_[q]->tasks.push_back({std::move(task), nested});
+    }
+    wake_.notify_one();
+}
+
+void WorkStealingPool::wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_.wait(lock, [this]() { return unfinished_ == 0; });
+}
+
+bool WorkStealingPool::take(size_t self, std::function<void()> &task) {
+    // Own deque first: the newest nested task (best cache locality), else
+    // the oldest task from outside, so submission order is kept
+    {
+        Queue &own = *queues_[self];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            if (own.tasks.back().nested) {
+                task = std::move(own.tasks.back().run);
+                own.tasks.pop_back();
+            } else {
+                task = std::move(own.tasks.front().run);
+                own.tasks.pop_front();
+            }
+            return true;
+        }
+    }
+    // Then steal the oldest task from the other workers
+    for (size_t k = 1; k < queues_.size(); k++) {
+        Queue &victim = *queues_[(self + k) % queues_.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front().run);
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkStealingPool::run(size_t self) {
+    t_pool = this;
+    t_workerIndex = self;
+
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [this]() { return stop_ || queued_ > 0; });
+            if (stop_ && queued_ == 0) return;
+        }
+
+        std::function<void()> task;
+        if (!take(self, task)) {
+            // Counted but not yet pushed, or taken by another worker
+            std::this_thread::yield();
+            continue;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            queued_--;
+        }
+        task();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (--unfinished_ == 0) idle_.notify_all();
+        }
+    }
+}
@@ -0,0 +1,72 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Number of worker threads to use when the caller asks for "all cores".
+unsigned hardwareJobs();
+
+// Run task(i) for every i in [0, count) on up to `jobs` threads (the
+// calling thread included). Tasks are claimed dynamically, so uneven task
+// costs balance out. Returns once every task has finished.
+void parallelFor(size_t count, unsigned jobs,
+                 const std::function<void(size_t)> &task);
+
+// Fixed-size pool where each worker owns a task deque. A worker runs the
+// tasks it submitted itself newest-first, then the ones submitted from
+// outside the pool in submission order, and when it runs dry steals the
+// oldest task from another worker. Long and short tasks spread across
+// threads without a central queue becoming the bottleneck, and a caller
+// that submits its longest tasks first has them started first.
+class WorkStealingPool {
+public:
+    explicit WorkStealingPool(unsigned threads);
+    ~WorkStealingPool();
+
+    WorkStealingPool(const WorkStealingPool &) = delete;
+    WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+
+    // Queue a task. Called from a worker, it goes on that worker's own deque;
+    // otherwise queues are filled round-robin.
+    void submit(std::function<void()> task);
+
+    // Block until every submitted task has finished.
+    void wait();
+
+    unsigned size() const { return static_cast<unsigned>(workers_.size()); }
+
+private:
+    struct Task {
+        std::function<void()> run;
+        bool nested;   // submitted by the worker that owns the deque
+    };
+
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;   // in submission order
+    };
+
+    bool take(size_t self, std::function<void()> &task);
+    void run(size_t self);
+
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::vector<std::thread> workers_;
+    std::atomic<size_t> nextQueue_{0};
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable idle_;
+    size_t queued_ = 0;       // tasks sitting in some deque
+    size_t unfinished_ = 0;   // tasks submitted but not yet completed
+    bool stop_ = false;
+};
+
+#endif
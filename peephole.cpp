@@ -0,0 +1,152 @@
+#include "peephole.h"
+#include <vector>
+
+static bool isControlTransfer(const IRInst &inst) {
+    if (!inst.def) return false;
+    switch (inst.def->pattern) {
+        case OperandPattern::R_SRC_ONLY:
+        case OperandPattern::I_SRC_TMP_LABEL:
+        case OperandPattern::J_LABEL:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Whether every operand parsed, so values can be trusted. Anything else is
+// left alone for the encoder to report.
+static bool isClean(const Program &program, const IRInst &inst) {
+    if (!inst.lowered()) return false;
+    const Operand *ops = program.operandsOf(inst);
+    int n = expectedOperandCount(inst.def->pattern);
+    for (int i = 0; i < n; i++) {
+        if (ops[i].kind == Operand::Kind::BadRegister ||
+            ops[i].kind == Operand::Kind::BadImmediate) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool is(const IRInst &inst, const char *mnemonic) {
+    return inst.def->mnemonic == mnemonic;
+}
+
+// Arithmetic that traps on signed overflow, so it has an effect even when
+// the result is discarded
+static bool canTrap(const IRInst &inst) {
+    return is(inst, "add") || is(inst, "sub") || is(inst, "addi");
+}
+
+static bool isNoOp(const Program &program, const IRInst &inst) {
+    const Operand *ops = program.operandsOf(inst);
+    uint32_t a = ops[0].value;
+    switch (inst.def->pattern) {
+        case OperandPattern::R_DST_SRC_TMP: {
+            uint32_t s = ops[1].value, t = ops[2].value;
+            if (a == 0) return !canTrap(inst);
+            if (is(inst, "addu") || is(inst, "add") || is(inst, "or")) {
+                if ((s == a && t == 0) || (s == 0 && t == a)) return true;
+            }
+            if (is(inst, "subu") || is(inst, "sub")) return s == a && t == 0;
+            if (is(inst, "and") || is(inst, "or")) return s == a && t == a;
+            return false;
+        }
+        case OperandPattern::R_DST_TMP_SHAMT:
+            return a == 0 || (ops[1].value == a && (ops[2].value & 0x1F) == 0);
+        case OperandPattern::I_TMP_SRC_IMM: {
+            if (a == 0) return !canTrap(inst);
+            bool zeroImm = (ops[2].value & 0xFFFF) == 0;
+            return ops[1].value == a && zeroImm &&
+                   (is(inst, "ori") || is(inst, "addiu") || is(inst, "addi"));
+        }
+        case OperandPattern::I_TMP_IMM:
+            return a == 0;
+        default:
+            // Loads may touch devices; stores and control flow always matter
+            return false;
+    }
+}
+
+static void setRegisterZero(Operand &op) {
+    op.kind = Operand::Kind::Register;
+    op.value = 0;
+    op.text = "$0";
+}
+
+static void retarget(IRInst &inst, const char *mnemonic) {
+    inst.def = findInstruction(mnemonic);
+    inst.mnemonic = inst.def->mnemonic;
+}
+
+PeepholeStats runPeephole(Program &program) {
+    PeepholeStats stats;
+    auto &insts = program.insts;
+    size_t n = insts.size();
+
+    std::vector<char> labeled(n + 1, 0);
+    for (const auto &label : program.labels) labeled[label.index] = 1;
+
+    std::vector<char> clean(n);
+    for (size_t i = 0; i < n; i++) clean[i] = isClean(program, insts[i]);
+
+    std::vector<char> keep(n, 1);
+    bool prevIsControl = false;   // previous kept instruction branches
+    for (size_t i = 0; i < n; i++) {
+        IRInst &inst = insts[i];
+        bool inDelaySlot = prevIsControl;
+
+        if (clean[i] && !inDelaySlot) {
+            Operand *ops = program.operands.data() + inst.firstOperand;
+
+            // lui $d,hi ; ori $d,$d,lo  ->  one instruction when hi allows
+            if (is(inst, "lui") && i + 1 < n && clean[i + 1] && !labeled[i + 1] &&
+                is(insts[i + 1], "ori")) {
+                IRInst &next = insts[i + 1];
+                Operand *nops = program.operands.data() + next.firstOperand;
+                uint32_t d = ops[0].value;
+                uint32_t hi = ops[1].value & 0xFFFF;
+                uint32_t lo = nops[2].value & 0xFFFF;
+                bool sameReg = d != 0 && nops[0].value == d && nops[1].value == d;
+                if (sameReg && ((hi == 0xFFFF && lo >= 0x8000) || hi == 0)) {
+                    if (hi == 0xFFFF) retarget(next, "addiu");   // sign-extends lo
+                    setRegisterZero(nops[1]);
+                    keep[i] = 0;
+                    stats.removed++;
+                    stats.rewritten++;
+                    continue;
+                }
+            }
+
+            if (isNoOp(program, inst)) {
+                keep[i] = 0;
+                stats.removed++;
+                continue;
+            }
+
+            // With a $0 source the sum cannot overflow
+            if ((is(inst, "add") || is(inst, "sub")) &&
+                (ops[2].value == 0 || (is(inst, "add") && ops[1].value == 0))) {
+                retarget(inst, is(inst, "add") ? "addu" : "subu");
+                stats.rewritten++;
+            }
+        }
+        prevIsControl = isControlTransfer(inst);
+    }
+
+    if (stats.removed == 0) return stats;
+
+    // Compact, mapping each old index to the next surviving instruction
+    std::vector<uint32_t> newIndex(n + 1);
+    size_t out = 0;
+    for (size_t i = 0; i < n; i++) {
+        newIndex[i] = static_cast<uint32_t>(out);
+        if (keep[i]) insts[out++] = insts[i];
+    }
+    newIndex[n] = static_cast<uint32_t>(out);
+    insts.resize(out);
+
+    for (auto &label : program.labels) label.index = newIndex[label.index];
+    program.bindLabels();
+    return stats;
+}
@@ -0,0 +1,25 @@
+#ifndef PEEPHOLE_H
+#define PEEPHOLE_H
+
+#include "ir.h"
+#include <cstddef>
+
+struct PeepholeStats {
+    size_t removed = 0;     // instructions deleted
+    size_t rewritten = 0;   // instructions replaced by a cheaper form
+};
+
+// Size optimization over a lowered program (-O):
+//   - lui $d,0xFFFF + ori $d,$d,lo (lo >= 0x8000) becomes addiu $d,$0,lo
+//     and lui $d,0 + ori $d,$d,lo becomes ori $d,$0,lo
+//   - add/sub with a $0 source become addu/subu (they cannot overflow)
+//   - instructions with no effect are deleted: nops (sll $0,$0,0), other
+//     non-trapping writes to $0, and self-moves such as ori $x,$x,0 or
+//     addu $x,$x,$0
+// Nothing in a branch delay slot is deleted or merged, and a pair is not
+// merged when a label points between its halves. Labels are rebound to
+// the new addresses. Code that computes instruction addresses without
+// labels is not adjusted.
+PeepholeStats runPeephole(Program &program);
+
+#endif
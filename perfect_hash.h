@@ -0,0 +1,84 @@
+#ifndef PERFECT_HASH_H
+#define PERFECT_HASH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// Compile-time perfect hash over a fixed set of string keys.
+//
+// The constructor searches for a hash seed that maps every key to a distinct
+// slot, so a lookup is one hash, one slot load and one key compare. Keys are
+// matched case-insensitively (ASCII only) and nothing is allocated.
+
+constexpr char asciiLower(char c) {
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+constexpr bool equalsIgnoreCase(std::string_view a, std::string_view b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); i++) {
+        if (asciiLower(a[i]) != asciiLower(b[i])) return false;
+    }
+    return true;
+}
+
+constexpr uint32_t hashIgnoreCase(std::string_view s, uint32_t seed) {
+    uint32_t h = 2166136261u ^ seed;
+    for (char c : s) {
+        h ^= static_cast<uint8_t>(asciiLower(c));
+        h *= 16777619u;
+    }
+    return h ^ (h >> 15);
+}
+
+// Maps each of N keys to its index in the caller's table. Slots must be a
+// power of two comfortably larger than N so a seed is found after a few
+// dozen attempts.
+template <size_t N, size_t Slots>
+class PerfectHashIndex {
+    static_assert((Slots & (Slots - 1)) == 0, "slot count must be a power of two");
+    static_assert(N < Slots && N < 0xFF, "too many keys for slot count");
+
+public:
+    // keyOf(i) returns the i-th key, for i in [0, N).
+    template <typename KeyOf>
+    constexpr explicit PerfectHashIndex(KeyOf keyOf)
+        : keys_(), slots_(), seed_(0) {
+        for (size_t i = 0; i < N; i++) keys_[i] = keyOf(i);
+        for (uint32_t seed = 1; seed != 0; seed++) {
+            if (tryBuild(seed)) {
+                seed_ = seed;
+                return;
+            }
+        }
+    }
+
+    // Index of key, or -1 if it is not in the set.
+    constexpr int find(std::string_view key) const {
+        uint8_t idx = slots_[hashIgnoreCase(key, seed_) & (Slots - 1)];
+        if (idx == EMPTY || !equalsIgnoreCase(keys_[idx], key)) return -1;
+        return idx;
+    }
+
+    constexpr bool valid() const { return seed_ != 0; }
+
+private:
+    static constexpr uint8_t EMPTY = 0xFF;
+
+    constexpr bool tryBuild(uint32_t seed) {
+        for (size_t s = 0; s < Slots; s++) slots_[s] = EMPTY;
+        for (size_t i = 0; i < N; i++) {
+            size_t s = hashIgnoreCase(keys_[i], seed) & (Slots - 1);
+            if (slots_[s] != EMPTY) return false;
+            slots_[s] = static_cast<uint8_t>(i);
+        }
+        return true;
+    }
+
+    std::string_view keys_[N];
+    uint8_t slots_[Slots];
+    uint32_t seed_;
+};
+
+#endif
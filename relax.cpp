@@ -0,0 +1,169 @@
+#include "relax.h"
+#include <algorithm>
+#include <vector>
+
+// A branch in range spans at most this many words, so only branches this
+// close to a growth point can straddle it
+static const uint32_t BRANCH_REACH = 32768;
+
+namespace {
+
+// Words inserted at each instruction, with prefix sums in O(log n)
+class GrowthTree {
+public:
+    explicit GrowthTree(size_t n) : tree_(n + 1, 0) {}
+
+    void add(uint32_t index, uint32_t words) {
+        for (size_t i = index + 1; i < tree_.size(); i += i & (~i + 1)) tree_[i] += words;
+    }
+
+    // Words inserted at instructions before `index`
+    uint32_t before(uint32_t index) const {
+        uint32_t sum = 0;
+        for (size_t i = index; i > 0; i -= i & (~i + 1)) sum += tree_[i];
+        return sum;
+    }
+
+private:
+    std::vector<uint32_t> tree_;
+};
+
+struct Branch {
+    uint32_t index;    // instruction
+    uint32_t target;   // instruction the label points at
+};
+
+} // namespace
+
+RelaxStats relaxBranches(Program &program, bool delaySlots) {
+    RelaxStats stats;
+    auto &insts = program.insts;
+    uint32_t n = static_cast<uint32_t>(insts.size());
+    const uint32_t growth = delaySlots ? 2 : 1;
+
+    // Branches to text labels, in address order. An undefined label is
+    // left for the encoder to report.
+    std::vector<Branch> branches;
+    for (uint32_t i = 0; i < n; i++) {
+        const IRInst &inst = insts[i];
+        if (!inst.lowered() || inst.def->pattern != OperandPattern::I_SRC_TMP_LABEL) continue;
+        const Operand &label = program.operandsOf(inst)[2];
+        if (!program.symbols.isDefined(label.value)) continue;
+        int target = program.symbols.address(label.value);
+        if (target < 0 || static_cast<uint32_t>(target) > n) continue;
+        branches.push_back({i, static_cast<uint32_t>(target)});
+    }
+
+    // Worklist to a fixed point. Growth only ever widens spans, so a branch
+    // that is relaxed stays relaxed and the order of checks does not matter.
+    // The worklist is drained in rounds, in address order, so the branches
+    // near one round's growth are each visited once.
+    size_t count = branches.size();
+    std::vector<char> relaxed(count, 0);
+    std::vector<uint32_t> work(count);
+    for (size_t b = 0; b < count; b++) work[b] = static_cast<uint32_t>(b);
+    std::vector<uint32_t> grown;   // instructions relaxed this round, ascending
+    GrowthTree tree(n);
+
+    while (!work.empty()) {
+        grown.clear();
+        for (uint32_t b : work) {
+            stats.checks++;
+            const Branch &branch = branches[b];
+            int from = static_cast<int>(branch.index + tree.before(branch.index));
+            int to = static_cast<int>(branch.target + tree.before(branch.target));
+            if (branchOffsetFits(branchOffset(to, from))) continue;
+
+            relaxed[b] = 1;
+            stats.relaxed++;
+            tree.add(branch.index, growth);
+            grown.push_back(branch.index);
+        }
+        work.clear();
+
+        // Code after each relaxed branch moved. Re-check the branches that
+        // jump across one of them; any that could still be in range lies
+        // within BRANCH_REACH of it.
+        size_t k = 0;
+        for (uint32_t g : grown) {
+            uint32_t low = g > BRANCH_REACH ? g - BRANCH_REACH : 0;
+            if (k < count && branches[k].index < low) {
+                k = std::lower_bound(branches.begin() + k, branches.end(), low,
+                                     [](const Branch &x, uint32_t i) { return x.index < i; }) -
+                    branches.begin();
+            }
+            for (; k < count && branches[k].index <= g + BRANCH_REACH; k++) {
+                if (relaxed[k]) continue;
+                // Growth at p moves everything after p, so it changes the
+                // span of a branch when p is in [min, max) of its ends
+                uint32_t lo = std::min(branches[k].index, branches[k].target);
+                uint32_t hi = std::max(branches[k].index, branches[k].target);
+                auto p = std::lower_bound(grown.begin(), grown.end(), lo);
+                if (p != grown.end() && *p < hi) work.push_back(static_cast<uint32_t>(k));
+            }
+        }
+    }
+
+    if (stats.relaxed == 0) return stats;
+
+    // Rebuild with the long forms. The opposite branch keeps the original
+    // operands with the label replaced by the skip; the j gets the label.
+    const InstructionDef *beq = findInstruction("beq");
+    const InstructionDef *bne = findInstruction("bne");
+    const InstructionDef *jump = findInstruction("j");
+    const InstructionDef *sll = findInstruction("sll");
+    program.operands.reserve(program.operands.size() + stats.relaxed + 3);
+    uint32_t nopOperands = static_cast<uint32_t>(program.operands.size());
+    if (delaySlots) {
+        program.operands.push_back({Operand::Kind::Register, 0, "$0"});
+        program.operands.push_back({Operand::Kind::Register, 0, "$0"});
+        program.operands.push_back({Operand::Kind::Immediate, 0, "0"});
+    }
+
+    std::vector<IRInst> out;
+    out.reserve(n + stats.relaxed * growth);
+    std::vector<uint32_t> newIndex(n + 1);
+    size_t next = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        newIndex[i] = static_cast<uint32_t>(out.size());
+        const IRInst &inst = insts[i];
+        bool isBranch = next < count && branches[next].index == i;
+        if (!isBranch || !relaxed[next++]) {
+            out.push_back(inst);
+            continue;
+        }
+
+        Operand &offset = program.operands[inst.firstOperand + 2];
+        Operand label = offset;
+        // Skip the j (and the nop before it)
+        offset = {Operand::Kind::Immediate, growth, delaySlots ? "2" : "1"};
+
+        IRInst inverted = inst;
+        inverted.def = inst.def == beq ? bne : beq;
+        inverted.mnemonic = inverted.def->mnemonic;
+        out.push_back(inverted);
+
+        if (delaySlots) {
+            IRInst nop = inst;
+            nop.def = sll;
+            nop.mnemonic = sll->mnemonic;
+            nop.firstOperand = nopOperands;
+            nop.numOperands = 3;
+            out.push_back(nop);
+        }
+
+        IRInst far = inst;
+        far.def = jump;
+        far.mnemonic = jump->mnemonic;
+        far.firstOperand = static_cast<uint32_t>(program.operands.size());
+        far.numOperands = 1;
+        program.operands.push_back(label);
+        out.push_back(far);
+    }
+    newIndex[n] = static_cast<uint32_t>(out.size());
+    insts = std::move(out);
+
+    for (auto &label : program.labels) label.index = newIndex[label.index];
+    program.bindLabels();
+    return stats;
+}
@@ -0,0 +1,25 @@
+#ifndef RELAX_H
+#define RELAX_H
+
+#include "ir.h"
+#include <cstddef>
+
+struct RelaxStats {
+    size_t relaxed = 0;   // branches rewritten into the long form
+    size_t checks = 0;    // range checks made, counting re-checks
+};
+
+// Branch relaxation. beq and bne reach about 32K words either way; one
+// whose text label is farther is rewritten as the opposite branch around
+// a j:
+//     beq $s,$t,far          ->  bne $s,$t,1 ; j far
+// With delaySlots the opposite branch gets a nop for its own slot and
+// lands on the original delay slot, which becomes the j's:
+//     beq $s,$t,far ; D      ->  bne $s,$t,2 ; nop ; j far ; D
+// Each rewrite moves the code after it, which can push other branches out
+// of range. Only branches whose span crosses the growth are checked again,
+// so the pass stays close to linear. Branches to undefined labels are left
+// for the encoder to report. Labels are rebound to the new addresses.
+RelaxStats relaxBranches(Program &program, bool delaySlots);
+
+#endif
@@ -0,0 +1,171 @@
+#include "scan.h"
+#include <atomic>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+using ClassifyFn = void (*)(const char *, CharMasks &);
+
+static void classifyScalar(const char *p, CharMasks &masks) {
+    CharMasks m{};
+    for (unsigned i = 0; i < 64; i++) {
+        uint64_t bit = 1ull << i;
+        switch (p[i]) {
+            case '\n': m.newline |= bit; break;
+            case '#':  m.hash |= bit; break;
+            case ':':  m.colon |= bit; break;
+            case ',':  m.comma |= bit; break;
+            case '(':  m.open |= bit; break;
+            case ')':  m.close |= bit; break;
+            case ' ':
+            case '\t': m.blank |= bit; break;
+            case '\r': m.cr |= bit; break;
+            default:   break;
+        }
+    }
+    masks = m;
+}
+
+#ifdef SCAN_X86
+
+__attribute__((target("sse2")))
+static inline uint64_t matches16(__m128i v, char c) {
+    return static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(c))));
+}
+
+__attribute__((target("sse2")))
+static void classifySSE2(const char *p, CharMasks &masks) {
+    CharMasks m{};
+    for (unsigned k = 0; k < 4; k++) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 16 * k));
+        unsigned shift = 16 * k;
+        m.newline |= matches16(v, '\n') << shift;
+        m.hash |= matches16(v, '#') << shift;
+        m.colon |= matches16(v, ':') << shift;
+        m.comma |= matches16(v, ',') << shift;
+        m.open |= matches16(v, '(') << shift;
+        m.close |= matches16(v, ')') << shift;
+        m.blank |= (matches16(v, ' ') | matches16(v, '\t')) << shift;
+        m.cr |= matches16(v, '\r') << shift;
+    }
+    masks = m;
+}
+
+__attribute__((target("avx2")))
+static inline uint64_t matches64(__m256i lo, __m256i hi, char c) {
+    __m256i needle = _mm256_set1_epi8(c);
+    uint64_t low = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, needle)));
+    uint64_t high = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, needle)));
+    return low | (high << 32);
+}
+
+__attribute__((target("avx2")))
+static void classifyAVX2(const char *p, CharMasks &masks) {
+    __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + 32));
+    masks.newline = matches64(lo, hi, '\n');
+    masks.hash = matches64(lo, hi, '#');
+    masks.colon = matches64(lo, hi, ':');
+    masks.comma = matches64(lo, hi, ',');
+    masks.open = matches64(lo, hi, '(');
+    masks.close = matches64(lo, hi, ')');
+    masks.blank = matches64(lo, hi, ' ') | matches64(lo, hi, '\t');
+    masks.cr = matches64(lo, hi, '\r');
+}
+
+#endif
+
+static ClassifyFn kernelFunction(ScanKernel kernel) {
+    switch (kernel) {
+#ifdef SCAN_X86
+        case ScanKernel::SSE2: return classifySSE2;
+        case ScanKernel::AVX2: return classifyAVX2;
+#endif
+        default:               return classifyScalar;
+    }
+}
+
+bool scanKernelSupported(ScanKernel kernel) {
+    switch (kernel) {
+        case ScanKernel::Scalar: return true;
+#ifdef SCAN_X86
+        case ScanKernel::SSE2:   return __builtin_cpu_supports("sse2");
+        case ScanKernel::AVX2:   return __builtin_cpu_supports("avx2");
+#endif
+        default:                 return false;
+    }
+}
+
+const char *scanKernelName(ScanKernel kernel) {
+    switch (kernel) {
+        case ScanKernel::Scalar: return "scalar";
+        case ScanKernel::SSE2:   return "sse2";
+        case ScanKernel::AVX2:   return "avx2";
+    }
+    return "?";
+}
+
+static ScanKernel bestKernel() {
+    if (scanKernelSupported(ScanKernel::AVX2)) return ScanKernel::AVX2;
+    if (scanKernelSupported(ScanKernel::SSE2)) return ScanKernel::SSE2;
+    return ScanKernel::Scalar;
+}
+
+namespace {
+
+struct KernelChoice {
+    std::atomic<ScanKernel> kernel;
+    std::atomic<ClassifyFn> classify;
+
+    KernelChoice() : kernel(bestKernel()), classify(kernelFunction(bestKernel())) {}
+};
+
+KernelChoice &choice() {
+    static KernelChoice c;
+    return c;
+}
+
+} // namespace
+
+ScanKernel scanKernel() {
+    return choice().kernel.load(std::memory_order_relaxed);
+}
+
+bool setScanKernel(ScanKernel kernel) {
+    if (!scanKernelSupported(kernel)) return false;
+    choice().kernel.store(kernel, std::memory_order_relaxed);
+    choice().classify.store(kernelFunction(kernel), std::memory_order_relaxed);
+    return true;
+}
+
+void classifyBlock(const char *p, CharMasks &masks) {
+    choice().classify.load(std::memory_order_relaxed)(p, masks);
+}
+
+void ScannedText::load(size_t base) {
+    // Moving forward, keep a little of what was just scanned
+    if (base >= windowEnd_ && base >= BACK_BLOCKS * 64) {
+        base -= BACK_BLOCKS * 64;
+    }
+    size_t size = text_.size();
+    size_t end = base + WINDOW_BLOCKS * 64;
+    if (end > size) end = (size + 63) & ~size_t(63);
+    windowBase_ = base;
+    windowEnd_ = end;
+
+    ClassifyFn classify = choice().classify.load(std::memory_order_relaxed);
+    size_t block = base;
+    CharMasks *out = window_;
+    for (; block + 64 <= end && block + 64 <= size; block += 64) {
+        classify(text_.data() + block, *out++);
+    }
+    if (block < end) {
+        // The last block is partial; pad it with bytes of no class
+        char padded[64] = {};
+        std::memcpy(padded, text_.data() + block, size - block);
+        classify(padded, *out);
+    }
+}
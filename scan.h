@@ -0,0 +1,106 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// Byte classes the lexer splits on, one bit per byte of a 64-byte block:
+// bit i of a mask is set when byte i is in that class.
+struct CharMasks {
+    uint64_t newline;   // '\n'
+    uint64_t hash;      // '#'
+    uint64_t colon;     // ':'
+    uint64_t comma;     // ','
+    uint64_t open;      // '('
+    uint64_t close;     // ')'
+    uint64_t blank;     // ' ' and '\t'
+    uint64_t cr;        // '\r'
+};
+
+// Implementations of classifyBlock. The best one the CPU supports is
+// picked at startup; the scalar one works everywhere.
+enum class ScanKernel {
+    Scalar,
+    SSE2,     // 16 bytes per compare
+    AVX2,     // 32 bytes per compare
+};
+
+// Classify the 64 bytes at `p`.
+void classifyBlock(const char *p, CharMasks &masks);
+
+bool scanKernelSupported(ScanKernel kernel);
+const char *scanKernelName(ScanKernel kernel);
+ScanKernel scanKernel();
+
+// Switch kernels, e.g. to compare them. Returns false if the CPU lacks
+// it. Not safe while other threads are lexing.
+bool setScanKernel(ScanKernel kernel);
+
+// A text classified a window of blocks at a time. Lookups are meant to
+// move forward through the text, so each block is classified about once;
+// a lookup may also reach back a few blocks behind the furthest one.
+class ScannedText {
+public:
+    explicit ScannedText(std::string_view text) : text_(text) {}
+
+    std::string_view text() const { return text_; }
+
+    // Position of the first byte in [from, limit) whose bit is set in
+    // select(masks), or `limit` if there is none.
+    template <typename Select>
+    size_t find(size_t from, size_t limit, Select select) {
+        if (from >= limit) return limit;
+        size_t base = from & ~size_t(63);
+        uint64_t bits = select(block(base)) & (~0ull << (from - base));
+        for (;;) {
+            if (bits) {
+                size_t i = base + static_cast<size_t>(__builtin_ctzll(bits));
+                return i < limit ? i : limit;
+            }
+            base += 64;
+            if (base >= limit) return limit;
+            bits = select(block(base));
+        }
+    }
+
+    // Call fn(position) for each byte in [from, limit) whose bit is set in
+    // select(masks), in order.
+    template <typename Select, typename Fn>
+    void forEach(size_t from, size_t limit, Select select, Fn fn) {
+        if (from >= limit) return;
+        size_t base = from & ~size_t(63);
+        uint64_t bits = select(block(base)) & (~0ull << (from - base));
+        for (;;) {
+            while (bits) {
+                size_t i = base + static_cast<size_t>(__builtin_ctzll(bits));
+                if (i >= limit) return;
+                fn(i);
+                bits &= bits - 1;
+            }
+            base += 64;
+            if (base >= limit) return;
+            bits = select(block(base));
+        }
+    }
+
+private:
+    static constexpr size_t WINDOW_BLOCKS = 64;
+    // Blocks kept behind the one that moved the window
+    static constexpr size_t BACK_BLOCKS = 2;
+
+    // Masks of the block at `base`, a multiple of 64
+    const CharMasks &block(size_t base) {
+        if (base < windowBase_ || base >= windowEnd_) load(base);
+        return window_[(base - windowBase_) / 64];
+    }
+
+    void load(size_t base);
+
+    std::string_view text_;
+    size_t windowBase_ = 0;   // window covers [windowBase_, windowEnd_)
+    size_t windowEnd_ = 0;
+    CharMasks window_[WINDOW_BLOCKS];
+};
+
+#endif
@@ -0,0 +1,212 @@
+#include "schedule.h"
+#include <set>
+#include <vector>
+
+// How far before a branch to look for an instruction to put in its slot
+static const uint32_t DELAY_SLOT_WINDOW = 8;
+
+static bool stallsAfter(const RegisterEffects &prev, const RegisterEffects &next) {
+    return prev.load && (prev.defs & next.uses) != 0;
+}
+
+static bool isNop(const Program &program, const IRInst &inst) {
+    if (!inst.lowered() || inst.def->mnemonic != "sll") return false;
+    const Operand *ops = program.operandsOf(inst);
+    return ops[0].kind == Operand::Kind::Register && ops[0].value == 0 &&
+           ops[1].kind == Operand::Kind::Register && ops[1].value == 0 &&
+           ops[2].kind == Operand::Kind::Immediate && (ops[2].value & 0x1F) == 0;
+}
+
+// Whether b must stay after a (a earlier in program order)
+static bool dependsOn(const RegisterEffects &a, const RegisterEffects &b) {
+    if (a.defs & (b.uses | b.defs)) return true;   // RAW, WAW
+    if (a.uses & b.defs) return true;              // WAR
+    bool memA = a.load || a.store, memB = b.load || b.store;
+    return memA && memB && (a.store || b.store);
+}
+
+size_t countLoadUseStalls(const Program &program) {
+    size_t stalls = 0;
+    RegisterEffects prev;
+    for (const auto &inst : program.insts) {
+        RegisterEffects fx = effectsOf(program, inst);
+        if (stallsAfter(prev, fx)) stalls++;
+        prev = fx;
+    }
+    return stalls;
+}
+
+// List-schedule insts[begin, end) in place: each step emits the earliest
+// ready instruction that does not read the register loaded by the one just
+// emitted, falling back to the earliest ready one.
+static void scheduleBody(std::vector<IRInst> &insts, const std::vector<RegisterEffects> &fx,
+                         uint32_t begin, uint32_t end) {
+    uint32_t m = end - begin;
+    if (m < 3) return;
+
+    // Dependency edges, found by tracking the last writer and the readers
+    // since then for each register, and the same for memory
+    std::vector<std::vector<uint32_t>> succs(m);
+    std::vector<uint32_t> preds(m, 0);
+    auto edge = [&](uint32_t from, uint32_t to) {
+        succs[from].push_back(to);
+        preds[to]++;
+    };
+    const uint32_t NONE = UINT32_MAX;
+    uint32_t lastDef[32];
+    std::vector<uint32_t> readers[32];
+    for (auto &d : lastDef) d = NONE;
+    uint32_t lastStore = NONE;
+    std::vector<uint32_t> loadsSinceStore;
+
+    for (uint32_t k = 0; k < m; k++) {
+        const RegisterEffects &f = fx[begin + k];
+        for (int r = 1; r < 32; r++) {
+            uint32_t bit = 1u << r;
+            if ((f.uses & bit) && lastDef[r] != NONE) edge(lastDef[r], k);
+            if (f.defs & bit) {
+                if (lastDef[r] != NONE) edge(lastDef[r], k);
+                for (uint32_t reader : readers[r]) {
+                    if (reader != k) edge(reader, k);
+                }
+            }
+        }
+        for (int r = 1; r < 32; r++) {
+            uint32_t bit = 1u << r;
+            if (f.defs & bit) {
+                lastDef[r] = k;
+                readers[r].clear();
+            }
+            if ((f.uses & bit) && !(f.defs & bit)) readers[r].push_back(k);
+        }
+        if (f.load) {
+            if (lastStore != NONE) edge(lastStore, k);
+            loadsSinceStore.push_back(k);
+        }
+        if (f.store) {
+            if (lastStore != NONE) edge(lastStore, k);
+            for (uint32_t load : loadsSinceStore) edge(load, k);
+            loadsSinceStore.clear();
+            lastStore = k;
+        }
+    }
+
+    std::set<uint32_t> ready;
+    for (uint32_t k = 0; k < m; k++) {
+        if (preds[k] == 0) ready.insert(k);
+    }
+
+    std::vector<uint32_t> order;
+    order.reserve(m);
+    const RegisterEffects *prev = nullptr;
+    while (!ready.empty()) {
+        uint32_t pick = *ready.begin();
+        if (prev && prev->load) {
+            for (uint32_t k : ready) {
+                if (!stallsAfter(*prev, fx[begin + k])) {
+                    pick = k;
+                    break;
+                }
+            }
+        }
+        ready.erase(pick);
+        order.push_back(pick);
+        prev = &fx[begin + pick];
+        for (uint32_t s : succs[pick]) {
+            if (--preds[s] == 0) ready.insert(s);
+        }
+    }
+
+    std::vector<IRInst> body(insts.begin() + begin, insts.begin() + end);
+    for (uint32_t k = 0; k < m; k++) insts[begin + k] = body[order[k]];
+}
+
+ScheduleStats runScheduler(Program &program, bool delaySlots) {
+    ScheduleStats stats;
+    stats.stallsBefore = countLoadUseStalls(program);
+
+    auto &insts = program.insts;
+    size_t n = insts.size();
+    std::vector<char> labeled(n + 1, 0);
+    for (const auto &label : program.labels) labeled[label.index] = 1;
+
+    std::vector<BasicBlock> blocks = basicBlocks(program, delaySlots);
+    std::vector<RegisterEffects> fx(n);
+    for (size_t i = 0; i < n; i++) fx[i] = effectsOf(program, insts[i]);
+
+    std::vector<char> keep(n, 1);
+    for (const BasicBlock &block : blocks) {
+        // The body is everything before the branch and its delay slot
+        uint32_t bodyEnd = block.end;
+        uint32_t branch = UINT32_MAX;
+        for (uint32_t i = block.begin; i < block.end; i++) {
+            if (fx[i].control) {
+                bodyEnd = branch = i;
+                break;
+            }
+        }
+        bool opaque = false;
+        for (uint32_t i = block.begin; i < bodyEnd; i++) opaque |= fx[i].opaque;
+        if (opaque) continue;
+
+        scheduleBody(insts, fx, block.begin, bodyEnd);
+        for (uint32_t i = block.begin; i < bodyEnd; i++) fx[i] = effectsOf(program, insts[i]);
+
+        // Fill a nop delay slot with an earlier independent instruction,
+        // preferring one that is not a load
+        uint32_t slot = branch + 1;
+        if (!delaySlots || branch == UINT32_MAX || slot >= block.end || labeled[slot] ||
+            !isNop(program, insts[slot])) {
+            continue;
+        }
+        uint32_t chosen = UINT32_MAX;
+        uint32_t low = bodyEnd > block.begin + DELAY_SLOT_WINDOW ? bodyEnd - DELAY_SLOT_WINDOW
+                                                                 : block.begin;
+        for (uint32_t c = bodyEnd; c-- > low;) {
+            if (labeled[c]) break;
+            const RegisterEffects &f = fx[c];
+            if (dependsOn(f, fx[branch])) continue;
+            bool blocked = false;
+            for (uint32_t x = c + 1; x < bodyEnd && !blocked; x++) {
+                blocked = dependsOn(f, fx[x]);
+            }
+            if (blocked) continue;
+            if (chosen == UINT32_MAX) chosen = c;
+            if (!f.load) {
+                chosen = c;
+                break;
+            }
+        }
+        if (chosen == UINT32_MAX) continue;
+
+        // Shift the rest of the body up and put the instruction in the slot
+        IRInst moved = insts[chosen];
+        RegisterEffects movedFx = fx[chosen];
+        for (uint32_t i = chosen; i < branch; i++) {
+            insts[i] = insts[i + 1];
+            fx[i] = fx[i + 1];
+        }
+        insts[branch] = moved;
+        fx[branch] = movedFx;
+        keep[slot] = 0;
+        stats.slotsFilled++;
+    }
+
+    if (stats.slotsFilled > 0) {
+        // Drop the replaced nops; labels only mark block starts, and block
+        // starts keep their relative order
+        std::vector<uint32_t> newIndex(n + 1);
+        size_t out = 0;
+        for (size_t i = 0; i < n; i++) {
+            newIndex[i] = static_cast<uint32_t>(out);
+            if (keep[i]) insts[out++] = insts[i];
+        }
+        newIndex[n] = static_cast<uint32_t>(out);
+        insts.resize(out);
+        for (auto &label : program.labels) label.index = newIndex[label.index];
+        program.bindLabels();
+    }
+
+    stats.stallsAfter = countLoadUseStalls(program);
+    return stats;
+}
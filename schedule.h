@@ -0,0 +1,28 @@
+#ifndef SCHEDULE_H
+#define SCHEDULE_H
+
+#include "ir.h"
+#include <cstddef>
+
+struct ScheduleStats {
+    size_t stallsBefore = 0;   // load-use pairs in the input order
+    size_t stallsAfter = 0;
+    size_t slotsFilled = 0;    // delay-slot nops replaced by a moved instruction
+};
+
+// Count places where a load is immediately followed by a reader of the
+// loaded register (one stall each on a classic 5-stage pipeline).
+size_t countLoadUseStalls(const Program &program);
+
+// Opt-in scheduling pass (--schedule). Within each basic block,
+// independent instructions are reordered so a load's consumer does not
+// directly follow it. With delaySlots, the nop in a branch or jump delay
+// slot is also replaced by an earlier instruction of the block that
+// neither the branch nor anything after it depends on; without them the
+// word after a branch runs only on fall-through, so it starts the next
+// block and is scheduled with it.
+// Dependencies come from effectsOf(); loads are never moved past stores.
+// Labels are rebound.
+ScheduleStats runScheduler(Program &program, bool delaySlots);
+
+#endif
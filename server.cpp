@@ -0,0 +1,326 @@
+#include "server.h"
+#include "error.h"
+#include "parallel.h"
+#include "source.h"
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <signal.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// Largest ASM payload accepted, so a corrupt header can't exhaust memory
+static const size_t MAX_PAYLOAD = 256u << 20;
+
+// One client: where requests come from and where responses go. Responses
+// from different workers are serialized by writeMutex.
+struct Connection {
+    int in;
+    int out;
+    bool ownsFds;
+    std::mutex writeMutex;
+
+    Connection(int in, int out, bool ownsFds) : in(in), out(out), ownsFds(ownsFds) {}
+    ~Connection() {
+        if (ownsFds) {
+            ::close(in);
+            if (out != in) ::close(out);
+        }
+    }
+
+    void send(const std::string &response) {
+        std::lock_guard<std::mutex> lock(writeMutex);
+        size_t done = 0;
+        while (done < response.size()) {
+            ssize_t n = ::write(out, response.data() + done, response.size() - done);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return;   // client went away; nothing left to tell it
+            done += static_cast<size_t>(n);
+        }
+    }
+};
+
+// Buffered reads of header lines and fixed-length payloads from a fd.
+class FrameReader {
+public:
+    explicit FrameReader(int fd) : fd_(fd) {}
+
+    bool readLine(std::string &line) {
+        for (;;) {
+            size_t nl = buf_.find('\n', pos_);
+            if (nl != std::string::npos) {
+                line.assign(buf_, pos_, nl - pos_);
+                if (!line.empty() && line.back() == '\r') line.pop_back();
+                pos_ = nl + 1;
+                return true;
+            }
+            if (!fill()) return false;
+        }
+    }
+
+    bool readBytes(size_t n, std::string &out) {
+        while (buf_.size() - pos_ < n) {
+            if (!fill()) return false;
+        }
+        out.assign(buf_, pos_, n);
+        pos_ += n;
+        return true;
+    }
+
+private:
+    bool fill() {
+        // Drop consumed bytes before growing the buffer
+        if (pos_ > 0) {
+            buf_.erase(0, pos_);
+            pos_ = 0;
+        }
+        char chunk[65536];
+        ssize_t n;
+        do {
+            n = ::read(fd_, chunk, sizeof(chunk));
+        } while (n < 0 && errno == EINTR);
+        if (n <= 0) return false;
+        buf_.append(chunk, static_cast<size_t>(n));
+        return true;
+    }
+
+    int fd_;
+    std::string buf_;
+    size_t pos_ = 0;
+};
+
+struct Request {
+    std::string id;
+    bool singlePass = false;
+    bool optimize = false;
+    bool deadCode = false;
+    bool schedule = false;
+    bool isFile = false;
+    std::string path;
+    std::string source;
+};
+
+static void appendHexWord(std::string &out, uint32_t word) {
+    static const char DIGITS[] = "0123456789abcdef";
+    char buf[8];
+    for (int i = 7; i >= 0; i--) {
+        buf[i] = DIGITS[word & 0xF];
+        word >>= 4;
+    }
+    out.append(buf, 8);
+}
+
+static std::string formatResponse(const std::string &id, bool ok,
+                                  const std::vector<EncodedInst> &encoded,
+                                  const std::vector<Diagnostic> &diagnostics) {
+    std::string out;
+    out.reserve(64 + encoded.size() * 9);
+    out += "RESULT " + id + (ok ? " ok " : " failed ") + std::to_string(encoded.size()) +
+           " " + std::to_string(diagnostics.size()) + "\n";
+    if (!encoded.empty()) {
+        for (size_t i = 0; i < encoded.size(); i++) {
+            if (i > 0) out += ' ';
+            appendHexWord(out, encoded[i].word);
+        }
+        out += '\n';
+    }
+    for (const auto &d : diagnostics) {
+        out += d.severity == Severity::Error ? 'E' : d.severity == Severity::Warning ? 'W' : 'I';
+        out += ' ' + std::to_string(d.line) + ' ' + d.message + '\n';
+    }
+    return out;
+}
+
+static std::string runRequest(Request &req, const AssemblerOptions &base) {
+    AssemblerOptions options = base;
+    options.singlePass = req.singlePass;
+    options.optimize = req.optimize;
+    options.deadCode = req.deadCode;
+    options.schedule = req.schedule;
+    options.jobs = 1;   // parallelism comes from serving requests concurrently
+
+    ErrorContext errors(true);
+    ErrorScope scope(errors);
+    errors.setOptions(options.diagnostics);
+    SourceBuffer source;
+    std::vector<EncodedInst> encoded;
+    bool ok;
+    if (req.isFile && !source.open(req.path)) {
+        reportError(0, DiagCode::Io, "cannot open file '" + req.path + "'");
+        ok = false;
+    } else {
+        if (!req.isFile) source.assign(std::move(req.source));
+        errors.setSource(source.text(), req.isFile ? req.path : std::string());
+        ok = assembleSource(source, options, encoded);
+    }
+    if (!ok) encoded.clear();
+    return formatResponse(req.id, ok, encoded, errors.printed());
+}
+
+static std::string rejectRequest(const std::string &id, const std::string &msg) {
+    return formatResponse(id.empty() ? "-" : id, false, {}, {{0, Severity::Error, msg}});
+}
+
+// Parse one header line. Returns false if the stream can't continue.
+static bool readRequest(FrameReader &reader, const std::string &header, Request &req,
+                        std::string &error) {
+    size_t pos = 0;
+    auto nextWord = [&]() {
+        size_t start = header.find_first_not_of(' ', pos);
+        if (start == std::string::npos) {
+            pos = header.size();
+            return std::string();
+        }
+        size_t end = header.find(' ', start);
+        if (end == std::string::npos) end = header.size();
+        pos = end;
+        return header.substr(start, end - start);
+    };
+
+    std::string verb = nextWord();
+    req.id = nextWord();
+    if (req.id.empty()) {
+        error = "missing request id";
+        return verb != "ASM";   // an ASM payload of unknown length can't be skipped
+    }
+
+    if (verb == "ASM") {
+        std::string length = nextWord();
+        char *end = nullptr;
+        unsigned long long n = std::strtoull(length.c_str(), &end, 10);
+        if (length.empty() || *end != '\0' || n > MAX_PAYLOAD) {
+            error = "invalid payload length '" + length + "'";
+            return false;
+        }
+        for (std::string opt = nextWord(); !opt.empty(); opt = nextWord()) {
+            if (opt == "--single-pass") req.singlePass = true;
+            else if (opt == "-O") req.optimize = true;
+            else if (opt == "--dce") req.deadCode = true;
+            else if (opt == "--schedule") req.schedule = true;
+            else if (error.empty()) error = "unknown option '" + opt + "'";
+        }
+        if (!reader.readBytes(static_cast<size_t>(n), req.source)) {
+            error = "truncated payload";
+            return false;
+        }
+        return true;
+    }
+
+    if (verb == "FILE") {
+        req.isFile = true;
+        for (;;) {
+            size_t save = pos;
+            std::string opt = nextWord();
+            if (opt == "--single-pass") {
+                req.singlePass = true;
+                continue;
+            }
+            if (opt == "-O") {
+                req.optimize = true;
+                continue;
+            }
+            if (opt == "--dce") {
+                req.deadCode = true;
+                continue;
+            }
+            if (opt == "--schedule") {
+                req.schedule = true;
+                continue;
+            }
+            pos = save;
+            break;
+        }
+        size_t start = header.find_first_not_of(' ', pos);
+        if (start == std::string::npos) {
+            error = "missing file path";
+        } else {
+            req.path = header.substr(start);
+        }
+        return true;
+    }
+
+    error = "unknown request '" + verb + "'";
+    return true;
+}
+
+// Read requests until EOF or QUIT, handing each to the pool.
+static void serveConnection(const std::shared_ptr<Connection> &conn,
+                            WorkStealingPool &pool, const AssemblerOptions &options) {
+    FrameReader reader(conn->in);
+    std::string header;
+    while (reader.readLine(header)) {
+        if (header.empty()) continue;
+        if (header == "QUIT") break;
+
+        auto req = std::make_shared<Request>();
+        std::string error;
+        bool more = readRequest(reader, header, *req, error);
+        if (!error.empty()) {
+            conn->send(rejectRequest(req->id, error));
+            if (!more) break;
+            continue;
+        }
+        pool.submit([conn, req, &options]() {
+            conn->send(runRequest(*req, options));
+        });
+    }
+}
+
+int serveStdio(const AssemblerOptions &options) {
+    WorkStealingPool pool(std::max(options.jobs, 1u));
+    auto conn = std::make_shared<Connection>(STDIN_FILENO, STDOUT_FILENO, false);
+    serveConnection(conn, pool, options);
+    pool.wait();
+    return 0;
+}
+
+int serveSocket(const std::string &path, const AssemblerOptions &options) {
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        reportError(0, DiagCode::Io, "socket path too long: '" + path + "'");
+        return 1;
+    }
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+
+    int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) {
+        reportError(0, DiagCode::Io, "cannot create socket");
+        return 1;
+    }
+    ::unlink(path.c_str());
+    if (::bind(listener, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 ||
+        ::listen(listener, 64) != 0) {
+        reportError(0, DiagCode::Io, "cannot listen on '" + path + "'");
+        ::close(listener);
+        return 1;
+    }
+
+    // A client that disconnects early must not kill the server
+    signal(SIGPIPE, SIG_IGN);
+
+    WorkStealingPool pool(std::max(options.jobs, 1u));
+    for (;;) {
+        int fd = ::accept(listener, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            reportError(0, DiagCode::Io, "accept failed on '" + path + "'");
+            break;
+        }
+        // The connection closes once its reader and every queued response
+        // have let go of it
+        auto conn = std::make_shared<Connection>(fd, fd, true);
+        std::thread([conn, &pool, &options]() {
+            serveConnection(conn, pool, options);
+        }).detach();
+    }
+    ::close(listener);
+    pool.wait();
+    return 1;
+}
@@ -0,0 +1,33 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "assembler.h"
+#include <string>
+
+// Resident assembler. Requests are read from a stream and assembled
+// concurrently on a work-stealing pool; each response carries the request
+// ID, so responses may arrive out of order. Nothing is written to disk.
+//
+// Requests (one header line, then the payload for ASM):
+//   ASM <id> <bytes> [options]     followed by <bytes> of source
+//   FILE <id> [options] <path>     path runs to the end of the line
+//   QUIT
+//
+// Response:
+//   RESULT <id> ok|failed <words> <diagnostics>
+//   <words 8-digit hex words separated by spaces>   (omitted when 0 words;
+//                                                    .data is not returned)
+//   <severity> <line> <message>                     (one per diagnostic)
+//
+// Options are --single-pass, -O, --dce and --schedule. Severity is E, W or I. A
+// malformed request gets a RESULT with status "failed", no words and one
+// diagnostic, and ends the session when the payload length is unknown.
+
+// Serve requests on stdin, answering on stdout, until EOF or QUIT.
+int serveStdio(const AssemblerOptions &options);
+
+// Listen on a Unix domain socket at `path`, serving each connection as
+// above. Connections share one pool. Runs until the process is killed.
+int serveSocket(const std::string &path, const AssemblerOptions &options);
+
+#endif
@@ -0,0 +1,393 @@
+#include "sim.h"
+#include "error.h"
+#include "isa.h"
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace {
+
+enum class Op : uint8_t {
+    Add, Addi, Addiu, Addu, And, Andi, Beq, Bne, J, Jal, Jr, Lbu, Lhu, Lui, Lw,
+    Nor, Or, Ori, Sb, Sh, Sll, Slt, Slti, Sltiu, Sltu, Srl, Sub, Subu, Sw,
+    Invalid,
+};
+
+struct OpName {
+    std::string_view mnemonic;
+    Op op;
+};
+
+const OpName OP_NAMES[] = {
+    {"add", Op::Add},   {"addi", Op::Addi},   {"addiu", Op::Addiu}, {"addu", Op::Addu},
+    {"and", Op::And},   {"andi", Op::Andi},   {"beq", Op::Beq},     {"bne", Op::Bne},
+    {"j", Op::J},       {"jal", Op::Jal},     {"jr", Op::Jr},       {"lbu", Op::Lbu},
+    {"lhu", Op::Lhu},   {"lui", Op::Lui},     {"lw", Op::Lw},       {"nor", Op::Nor},
+    {"or", Op::Or},     {"ori", Op::Ori},     {"sb", Op::Sb},       {"sh", Op::Sh},
+    {"sll", Op::Sll},   {"slt", Op::Slt},     {"slti", Op::Slti},   {"sltiu", Op::Sltiu},
+    {"sltu", Op::Sltu}, {"srl", Op::Srl},     {"sub", Op::Sub},     {"subu", Op::Subu},
+    {"sw", Op::Sw},
+};
+
+// Register index that absorbs writes to $0
+const uint8_t SINK = 32;
+
+// One image word, decoded once. Register fields are ready to index the
+// register file; imm is pre-extended the way the instruction uses it, and
+// target is the resolved branch or jump destination.
+struct Decoded {
+    Op op;
+    uint8_t d;        // destination (SINK for $0)
+    uint8_t s;
+    uint8_t t;
+    uint32_t imm;
+    uint32_t target;
+};
+
+Decoded decode(uint32_t word, uint32_t pc) {
+    Decoded x{Op::Invalid, SINK, 0, 0, 0, 0};
+    const InstructionDef *def = decodeInstruction(word);
+    if (!def) return x;
+    for (const auto &n : OP_NAMES) {
+        if (n.mnemonic == def->mnemonic) x.op = n.op;
+    }
+
+    uint8_t rs = (word >> 21) & 0x1F;
+    uint8_t rt = (word >> 16) & 0x1F;
+    uint8_t rd = (word >> 11) & 0x1F;
+    uint32_t shamt = (word >> 6) & 0x1F;
+    uint32_t zext = word & 0xFFFF;
+    uint32_t sext = static_cast<uint32_t>(static_cast<int32_t>(static_cast<int16_t>(zext)));
+    auto dest = [](uint8_t r) { return r == 0 ? SINK : r; };
+
+    x.s = rs;
+    x.t = rt;
+    switch (def->pattern) {
+        case OperandPattern::R_DST_SRC_TMP:
+            x.d = dest(rd);
+            break;
+        case OperandPattern::R_DST_TMP_SHAMT:
+            x.d = dest(rd);
+            x.imm = shamt;
+            break;
+        case OperandPattern::R_SRC_ONLY:
+            break;
+        case OperandPattern::I_TMP_SRC_IMM:
+            x.d = dest(rt);
+            // Logical immediates zero-extend, arithmetic ones sign-extend
+            x.imm = (x.op == Op::Andi || x.op == Op::Ori) ? zext : sext;
+            break;
+        case OperandPattern::I_TMP_IMM:
+            x.d = dest(rt);
+            x.imm = zext << 16;
+            break;
+        case OperandPattern::I_SRC_TMP_LABEL:
+            x.target = static_cast<uint32_t>(
+                branchTarget(static_cast<int16_t>(zext), static_cast<int>(pc)));
+            break;
+        case OperandPattern::I_TMP_OFF_SRC:
+            x.d = dest(rt);
+            x.imm = sext;
+            break;
+        case OperandPattern::J_LABEL:
+            x.target = word & 0x03FFFFFF;
+            break;
+    }
+    return x;
+}
+
+// Sparse byte-addressed memory in 4 KiB pages behind a flat page table
+class Memory {
+public:
+    Memory() : pages_(PAGE_COUNT) {}
+
+    uint8_t load8(uint32_t addr) const {
+        const Page *p = pages_[addr >> PAGE_BITS].get();
+        return p ? p->bytes[addr & PAGE_MASK] : 0;
+    }
+
+    void store8(uint32_t addr, uint8_t value) {
+        auto &p = pages_[addr >> PAGE_BITS];
+        if (!p) p = std::make_unique<Page>();
+        p->bytes[addr & PAGE_MASK] = value;
+    }
+
+    uint32_t load(uint32_t addr, int bytes) const {
+        uint32_t off = addr & PAGE_MASK;
+        if (off + bytes <= PAGE_SIZE) {
+            // Common case: one page lookup
+            const Page *p = pages_[addr >> PAGE_BITS].get();
+            if (!p) return 0;
+            uint32_t v = 0;
+            for (int i = 0; i < bytes; i++) v = (v << 8) | p->bytes[off + i];
+            return v;
+        }
+        uint32_t v = 0;
+        for (int i = 0; i < bytes; i++) v = (v << 8) | load8(addr + i);
+        return v;
+    }
+
+    void store(uint32_t addr, uint32_t value, int bytes) {
+        uint32_t off = addr & PAGE_MASK;
+        if (off + bytes <= PAGE_SIZE) {
+            auto &p = pages_[addr >> PAGE_BITS];
+            if (!p) p = std::make_unique<Page>();
+            for (int i = bytes - 1; i >= 0; i--) {
+                p->bytes[off + i] = static_cast<uint8_t>(value);
+                value >>= 8;
+            }
+            return;
+        }
+        for (int i = bytes - 1; i >= 0; i--) {
+            store8(addr + i, static_cast<uint8_t>(value));
+            value >>= 8;
+        }
+    }
+
+    // Non-zero 32-bit words of every touched page, in address order
+    std::vector<std::pair<uint32_t, uint32_t>> snapshot() const {
+        std::vector<std::pair<uint32_t, uint32_t>> words;
+        for (size_t page = 0; page < PAGE_COUNT; page++) {
+            if (!pages_[page]) continue;
+            uint32_t base = static_cast<uint32_t>(page << PAGE_BITS);
+            for (uint32_t off = 0; off < PAGE_SIZE; off += 4) {
+                uint32_t w = load(base + off, 4);
+                if (w) words.push_back({base + off, w});
+            }
+        }
+        return words;
+    }
+
+private:
+    static const int PAGE_BITS = 12;
+    static const uint32_t PAGE_SIZE = 1u << PAGE_BITS;
+    static const uint32_t PAGE_MASK = PAGE_SIZE - 1;
+    static const size_t PAGE_COUNT = size_t(1) << (32 - PAGE_BITS);
+    struct Page {
+        uint8_t bytes[PAGE_SIZE] = {};
+    };
+
+    std::vector<std::unique_ptr<Page>> pages_;
+};
+
+bool addOverflows(uint32_t a, uint32_t b, uint32_t sum) {
+    return ((a ^ sum) & (b ^ sum)) >> 31;
+}
+
+bool subOverflows(uint32_t a, uint32_t b, uint32_t diff) {
+    return ((a ^ b) & (a ^ diff)) >> 31;
+}
+
+const char *stopReason(SimStop stop) {
+    switch (stop) {
+        case SimStop::Halted:         return "halted (jump to self)";
+        case SimStop::LeftProgram:    return "PC left the program";
+        case SimStop::StepLimit:      return "step limit reached";
+        case SimStop::Overflow:       return "arithmetic overflow trap";
+        case SimStop::BadInstruction: return "unsupported instruction";
+    }
+    return "";
+}
+
+} // namespace
+
+SimResult simulate(const std::vector<uint32_t> &image, const SimOptions &options,
+                   const DataImage *data) {
+    SimResult result;
+    const uint32_t n = static_cast<uint32_t>(image.size());
+
+    std::vector<Decoded> code(n);
+    for (uint32_t pc = 0; pc < n; pc++) code[pc] = decode(image[pc], pc);
+
+    uint32_t regs[33] = {};   // $0..$31 plus the write sink
+    Memory mem;
+    if (data) {
+        for (const Extent &e : data->extents()) {
+            uint32_t addr = e.address;
+            for (unsigned char c : e.bytes) mem.store8(addr++, c);
+        }
+    }
+    std::vector<uint64_t> counts(n, 0);
+    uint64_t steps = 0;
+    uint32_t pc = 0;
+    // With delay slots, a taken branch sets `pending` and jumps only after
+    // the following word has run
+    uint32_t pending = UINT32_MAX;
+    SimStop stop = SimStop::LeftProgram;
+
+    while (pc < n) {
+        if (steps == options.maxSteps) {
+            stop = SimStop::StepLimit;
+            break;
+        }
+        const Decoded &x = code[pc];
+        counts[pc]++;
+        steps++;
+
+        uint32_t next = pc + 1;
+        uint32_t jump = UINT32_MAX;
+        SimStop trap = SimStop::Halted;   // anything else stops before retiring
+        uint32_t s = regs[x.s], t = regs[x.t];
+        switch (x.op) {
+            case Op::Add: {
+                uint32_t r = s + t;
+                if (addOverflows(s, t, r)) { trap = SimStop::Overflow; break; }
+                regs[x.d] = r;
+                break;
+            }
+            case Op::Addi: {
+                uint32_t r = s + x.imm;
+                if (addOverflows(s, x.imm, r)) { trap = SimStop::Overflow; break; }
+                regs[x.d] = r;
+                break;
+            }
+            case Op::Sub: {
+                uint32_t r = s - t;
+                if (subOverflows(s, t, r)) { trap = SimStop::Overflow; break; }
+                regs[x.d] = r;
+                break;
+            }
+            case Op::Addiu: regs[x.d] = s + x.imm; break;
+            case Op::Addu:  regs[x.d] = s + t; break;
+            case Op::Subu:  regs[x.d] = s - t; break;
+            case Op::And:   regs[x.d] = s & t; break;
+            case Op::Andi:  regs[x.d] = s & x.imm; break;
+            case Op::Or:    regs[x.d] = s | t; break;
+            case Op::Ori:   regs[x.d] = s | x.imm; break;
+            case Op::Nor:   regs[x.d] = ~(s | t); break;
+            case Op::Lui:   regs[x.d] = x.imm; break;
+            case Op::Sll:   regs[x.d] = t << x.imm; break;
+            case Op::Srl:   regs[x.d] = t >> x.imm; break;
+            case Op::Slt:   regs[x.d] = static_cast<int32_t>(s) < static_cast<int32_t>(t); break;
+            case Op::Sltu:  regs[x.d] = s < t; break;
+            case Op::Slti:  regs[x.d] = static_cast<int32_t>(s) < static_cast<int32_t>(x.imm); break;
+            case Op::Sltiu: regs[x.d] = s < x.imm; break;
+            case Op::Lw:    regs[x.d] = mem.load(s + x.imm, 4); break;
+            case Op::Lhu:   regs[x.d] = mem.load(s + x.imm, 2); break;
+            case Op::Lbu:   regs[x.d] = mem.load8(s + x.imm); break;
+            case Op::Sw:    mem.store(s + x.imm, t, 4); break;
+            case Op::Sh:    mem.store(s + x.imm, t, 2); break;
+            case Op::Sb:    mem.store8(s + x.imm, static_cast<uint8_t>(t)); break;
+            case Op::Beq:   if (s == t) jump = x.target; break;
+            case Op::Bne:   if (s != t) jump = x.target; break;
+            case Op::J:     jump = x.target; break;
+            case Op::Jal:
+                regs[31] = options.delaySlots ? pc + 2 : pc + 1;
+                jump = x.target;
+                break;
+            case Op::Jr:    jump = s; break;
+            case Op::Invalid:
+                trap = SimStop::BadInstruction;
+                break;
+        }
+        if (trap != SimStop::Halted) {
+            // The trapping instruction did not complete
+            counts[pc]--;
+            steps--;
+            stop = trap;
+            break;
+        }
+
+        if (jump == pc) {
+            stop = SimStop::Halted;
+            break;
+        }
+        if (pending != UINT32_MAX) {
+            // This was a delay slot; a branch in it is ignored
+            next = pending;
+            pending = UINT32_MAX;
+        } else if (jump != UINT32_MAX) {
+            if (options.delaySlots) pending = jump;
+            else next = jump;
+        }
+        pc = next;
+    }
+
+    result.stop = stop;
+    result.pc = pc;
+    result.steps = steps;
+    std::copy(regs, regs + 32, result.regs);
+    result.pcCounts = std::move(counts);
+    result.memory = mem.snapshot();
+    return result;
+}
+
+void reportSimulation(const SimResult &result, const std::vector<uint32_t> &image) {
+    char buf[160];
+    std::snprintf(buf, sizeof(buf), "Simulation: %llu instructions, stopped at PC 0x%03x: %s",
+                  static_cast<unsigned long long>(result.steps), result.pc,
+                  stopReason(result.stop));
+    reportInfo(buf);
+
+    // Instruction mix, from the per-PC counts
+    std::vector<std::pair<uint64_t, std::string_view>> mix;
+    for (const auto &n : OP_NAMES) mix.push_back({0, n.mnemonic});
+    for (size_t pc = 0; pc < result.pcCounts.size(); pc++) {
+        if (!result.pcCounts[pc]) continue;
+        const InstructionDef *def = decodeInstruction(image[pc]);
+        for (auto &m : mix) {
+            if (def && m.second == def->mnemonic) m.first += result.pcCounts[pc];
+        }
+    }
+    std::stable_sort(mix.begin(), mix.end(),
+                     [](const auto &a, const auto &b) { return a.first > b.first; });
+    std::string line = "Instruction counts:";
+    for (const auto &m : mix) {
+        if (!m.first) break;
+        line += " " + std::string(m.second) + "=" + std::to_string(m.first);
+    }
+    reportInfo(line);
+
+    // Hottest PCs
+    const size_t TOP_PCS = 16;
+    std::vector<uint32_t> pcs;
+    for (uint32_t pc = 0; pc < result.pcCounts.size(); pc++) {
+        if (result.pcCounts[pc]) pcs.push_back(pc);
+    }
+    std::stable_sort(pcs.begin(), pcs.end(), [&](uint32_t a, uint32_t b) {
+        return result.pcCounts[a] > result.pcCounts[b];
+    });
+    if (pcs.size() > TOP_PCS) pcs.resize(TOP_PCS);
+    reportInfo("PC histogram (hottest first):");
+    for (uint32_t pc : pcs) {
+        std::snprintf(buf, sizeof(buf), "  0x%03x  %08X  %12llu", pc, image[pc],
+                      static_cast<unsigned long long>(result.pcCounts[pc]));
+        reportInfo(buf);
+    }
+
+    reportInfo("Registers (non-zero):");
+    for (int r = 1; r < 32; r++) {
+        if (!result.regs[r]) continue;
+        std::snprintf(buf, sizeof(buf), "  $%-2d = 0x%08X", r, result.regs[r]);
+        reportInfo(buf);
+    }
+
+    const size_t MAX_WORDS = 64;
+    std::snprintf(buf, sizeof(buf), "Memory (non-zero words: %zu):", result.memory.size());
+    reportInfo(buf);
+    for (size_t i = 0; i < result.memory.size() && i < MAX_WORDS; i++) {
+        std::snprintf(buf, sizeof(buf), "  0x%08X: 0x%08X", result.memory[i].first,
+                      result.memory[i].second);
+        reportInfo(buf);
+    }
+    if (result.memory.size() > MAX_WORDS) reportInfo("  ...");
+}
+
+bool writeProfile(const SimResult &result, const std::string &path) {
+    std::FILE *f = std::fopen(path.c_str(), "w");
+    if (!f) {
+        reportError(0, DiagCode::Io, "cannot create profile '" + path + "'");
+        return false;
+    }
+    std::fprintf(f, "# word address, executions\n");
+    for (size_t pc = 0; pc < result.pcCounts.size(); pc++) {
+        if (!result.pcCounts[pc]) continue;
+        std::fprintf(f, "0x%03zx %llu\n", pc, static_cast<unsigned long long>(result.pcCounts[pc]));
+    }
+    bool ok = std::ferror(f) == 0;
+    ok &= std::fclose(f) == 0;
+    if (!ok) reportError(0, DiagCode::Io, "failed writing profile '" + path + "'");
+    return ok;
+}
@@ -0,0 +1,55 @@
+#ifndef SIM_H
+#define SIM_H
+
+#include "data.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Instruction-set simulator for encoded images (--run).
+//
+// The machine follows the assembler's conventions: the PC and jump
+// targets are word indices into the image, jal stores the word index of
+// the return point, and branch offsets decode with branchTarget().
+// Data memory is a separate, sparse, byte-addressed, big-endian space
+// with no alignment checks, initialized from the .data segment. Every
+// register starts at zero.
+
+struct SimOptions {
+    uint64_t maxSteps = 100000000;   // stop after this many instructions
+    bool delaySlots = false;         // run the word after a branch or jump first
+};
+
+enum class SimStop {
+    Halted,          // branch or jump to itself
+    LeftProgram,     // PC moved outside the image
+    StepLimit,
+    Overflow,        // add, sub or addi overflowed (trap)
+    BadInstruction,  // word is not a supported instruction
+};
+
+struct SimResult {
+    SimStop stop = SimStop::Halted;
+    uint32_t pc = 0;                  // where execution stopped
+    uint64_t steps = 0;               // instructions executed
+    uint32_t regs[32] = {};
+    std::vector<uint64_t> pcCounts;   // executions per image word
+    std::vector<std::pair<uint32_t, uint32_t>> memory;   // non-zero words, by address
+};
+
+// Pre-decode the image once, then run it from word 0. The .data segment,
+// if given, is loaded into data memory at its byte addresses first.
+SimResult simulate(const std::vector<uint32_t> &image, const SimOptions &options = SimOptions(),
+                   const DataImage *data = nullptr);
+
+// Write the per-word counts of a run in the format --profile reads: one
+// "0xADDR COUNT" line per word that ran. Reports a file it cannot write.
+bool writeProfile(const SimResult &result, const std::string &path);
+
+// Print the stop reason, instruction counts, the hottest PCs, and the
+// non-zero registers and memory words as Info diagnostics.
+void reportSimulation(const SimResult &result, const std::vector<uint32_t> &image);
+
+#endif
@@ -0,0 +1,89 @@
+#include "source.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+SourceBuffer::~SourceBuffer() {
+    release();
+}
+
+void SourceBuffer::release() {
+    if (map_) {
+        munmap(map_, mapSize_);
+        map_ = nullptr;
+        mapSize_ = 0;
+    }
+    owned_.clear();
+    text_ = std::string_view();
+}
+
+bool SourceBuffer::open(const std::string &path) {
+    release();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        return false;
+    }
+
+    if (S_ISREG(st.st_mode) && st.st_size > 0) {
+        size_t size = static_cast<size_t>(st.st_size);
+        void *p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            madvise(p, size, MADV_SEQUENTIAL);
+            ::close(fd);
+            map_ = p;
+            mapSize_ = size;
+            text_ = std::string_view(static_cast<const char *>(p), size);
+            return true;
+        }
+    }
+
+    // Pipes, empty files, or mmap failure: read the whole thing instead
+    char chunk[65536];
+    ssize_t n;
+    while ((n = ::read(fd, chunk, sizeof(chunk))) > 0) {
+        owned_.append(chunk, static_cast<size_t>(n));
+    }
+    ::close(fd);
+    if (n < 0) {
+        owned_.clear();
+        return false;
+    }
+    text_ = owned_;
+    return true;
+}
+
+void SourceBuffer::assign(std::string text) {
+    release();
+    owned_ = std::move(text);
+    text_ = owned_;
+}
+
+void SourceBuffer::borrow(std::string_view text) {
+    release();
+    text_ = text;
+}
+
+std::string_view SourceBuffer::store(std::string_view s) {
+    char *p;
+    if (s.size() > CHUNK_SIZE) {
+        // Too long for a chunk: it gets a block of its own, placed before
+        // the chunk being filled
+        auto at = chunks_.empty() ? chunks_.end() : chunks_.end() - 1;
+        p = chunks_.emplace(at, new char[s.size()])->get();
+    } else {
+        if (s.size() > CHUNK_SIZE - chunkUsed_) {
+            chunks_.emplace_back(new char[CHUNK_SIZE]);
+            chunkUsed_ = 0;
+        }
+        p = chunks_.back().get() + chunkUsed_;
+        chunkUsed_ += s.size();
+    }
+    s.copy(p, s.size());
+    return std::string_view(p, s.size());
+}
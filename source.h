@@ -0,0 +1,52 @@
+#ifndef SOURCE_H
+#define SOURCE_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Read-only view of an assembly source. Files are memory-mapped once and
+// every token produced by the lexer is a std::string_view into this buffer,
+// so the buffer must outlive the parsed lines and encoded output.
+class SourceBuffer {
+public:
+    SourceBuffer() = default;
+    ~SourceBuffer();
+
+    SourceBuffer(const SourceBuffer &) = delete;
+    SourceBuffer &operator=(const SourceBuffer &) = delete;
+
+    // Map (or, for non-regular files, read) the named file. Returns false if
+    // it cannot be opened.
+    bool open(const std::string &path);
+
+    // Use an in-memory copy of text instead of a file.
+    void assign(std::string text);
+
+    // Use the caller's text without copying; it must outlive the buffer.
+    void borrow(std::string_view text);
+
+    std::string_view text() const { return text_; }
+
+    // Keep a synthesized string (e.g. an immediate produced by pseudo
+    // expansion) alive for as long as the source, and return a view of it.
+    // Strings are copied into shared chunks, so storing one does not
+    // allocate unless the current chunk is full.
+    std::string_view store(std::string_view s);
+
+private:
+    void release();
+
+    static constexpr size_t CHUNK_SIZE = 64 * 1024;
+
+    std::string_view text_;
+    void *map_ = nullptr;
+    size_t mapSize_ = 0;
+    std::string owned_;
+    std::vector<std::unique_ptr<char[]>> chunks_;   // stored strings
+    size_t chunkUsed_ = CHUNK_SIZE;                 // bytes used in chunks_.back()
+};
+
+#endif
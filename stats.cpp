@@ -0,0 +1,114 @@
+#include "stats.h"
+#include "error.h"
+#include <atomic>
+#include <cstdio>
+
+// Advanced by the counting operator new in alloccount.cpp, which is only
+// linked into programs that call enableAllocationCounting()
+std::atomic<uint64_t> g_allocations{0};
+std::atomic<uint64_t> g_bytesAllocated{0};
+
+StageTimer::StageTimer(AssemblyStats *stats, const char *name)
+    : stats_(stats), name_(name) {
+    if (!stats_) return;
+    startAllocations_ = g_allocations.load(std::memory_order_relaxed);
+    startBytes_ = g_bytesAllocated.load(std::memory_order_relaxed);
+    start_ = std::chrono::steady_clock::now();
+}
+
+StageTimer::~StageTimer() {
+    if (!stats_) return;
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_;
+    uint64_t allocs = g_allocations.load(std::memory_order_relaxed) - startAllocations_;
+    uint64_t bytes = g_bytesAllocated.load(std::memory_order_relaxed) - startBytes_;
+    stats_->stages.push_back({name_, elapsed.count(), allocs, bytes});
+}
+
+void reportStats(const AssemblyStats &stats) {
+    char buf[160];
+    reportInfo("Stage               Time (ms)     Allocs        Bytes");
+    double total = 0;
+    uint64_t allocs = 0, bytes = 0;
+    for (const auto &s : stats.stages) {
+        std::snprintf(buf, sizeof(buf), "%-16s %12.3f %10llu %12llu", s.name,
+                      s.seconds * 1000.0, static_cast<unsigned long long>(s.allocations),
+                      static_cast<unsigned long long>(s.bytesAllocated));
+        reportInfo(buf);
+        total += s.seconds;
+        allocs += s.allocations;
+        bytes += s.bytesAllocated;
+    }
+    std::snprintf(buf, sizeof(buf), "%-16s %12.3f %10llu %12llu", "total",
+                  total * 1000.0, static_cast<unsigned long long>(allocs),
+                  static_cast<unsigned long long>(bytes));
+    reportInfo(buf);
+    std::snprintf(buf, sizeof(buf),
+                  "Lines: %zu  Instructions: %zu  Labels: %zu  Pseudo-expansions: %zu  "
+                  "Output bytes: %llu",
+                  stats.lines, stats.instructions, stats.labels, stats.pseudoExpansions,
+                  static_cast<unsigned long long>(stats.outputBytes));
+    reportInfo(buf);
+    if (stats.peepholeRemoved || stats.peepholeRewritten) {
+        std::snprintf(buf, sizeof(buf), "Peephole: %zu removed, %zu rewritten",
+                      stats.peepholeRemoved, stats.peepholeRewritten);
+        reportInfo(buf);
+    }
+    if (stats.branchesRelaxed) {
+        std::snprintf(buf, sizeof(buf), "Relaxation: %zu branches rewritten",
+                      stats.branchesRelaxed);
+        reportInfo(buf);
+    }
+}
+
+static void putJsonString(std::FILE *f, const std::string &s) {
+    std::fputc('"', f);
+    for (unsigned char c : s) {
+        if (c == '"' || c == '\\') {
+            std::fputc('\\', f);
+            std::fputc(c, f);
+        } else if (c < 0x20) {
+            std::fprintf(f, "\\u%04x", c);
+        } else {
+            std::fputc(c, f);
+        }
+    }
+    std::fputc('"', f);
+}
+
+bool writeStatsJson(const std::vector<AssemblyStats> &runs, const std::string &path) {
+    std::FILE *f = std::fopen(path.c_str(), "w");
+    if (!f) {
+        reportError(0, DiagCode::Io, "cannot open stats file '" + path + "'");
+        return false;
+    }
+
+    std::fputs("{\"files\":[", f);
+    for (size_t r = 0; r < runs.size(); r++) {
+        const AssemblyStats &st = runs[r];
+        std::fputs(r ? ",\n{\"input\":" : "\n{\"input\":", f);
+        putJsonString(f, st.inputFile);
+        std::fprintf(f, ",\"lines\":%zu,\"instructions\":%zu,\"labels\":%zu,"
+                        "\"pseudo_expansions\":%zu,\"peephole_removed\":%zu,"
+                        "\"peephole_rewritten\":%zu,\"branches_relaxed\":%zu,"
+                        "\"output_bytes\":%llu,\"stages\":[",
+                     st.lines, st.instructions, st.labels, st.pseudoExpansions,
+                     st.peepholeRemoved, st.peepholeRewritten, st.branchesRelaxed,
+                     static_cast<unsigned long long>(st.outputBytes));
+        for (size_t i = 0; i < st.stages.size(); i++) {
+            const StageStats &s = st.stages[i];
+            std::fprintf(f, "%s{\"name\":\"%s\",\"seconds\":%.9f,\"allocations\":%llu,"
+                            "\"bytes_allocated\":%llu}",
+                         i ? "," : "", s.name, s.seconds,
+                         static_cast<unsigned long long>(s.allocations),
+                         static_cast<unsigned long long>(s.bytesAllocated));
+        }
+        std::fputs("]}", f);
+    }
+    std::fputs("\n]}\n", f);
+
+    if (std::fclose(f) != 0) {
+        reportError(0, DiagCode::Io, "failed writing stats file '" + path + "'");
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,61 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct StageStats {
+    const char *name;
+    double seconds;
+    uint64_t allocations;      // operator new calls during the stage
+    uint64_t bytesAllocated;   // bytes requested from operator new
+};
+
+struct AssemblyStats {
+    std::string inputFile;
+    std::vector<StageStats> stages;
+    size_t lines = 0;              // non-blank source lines
+    size_t instructions = 0;       // words encoded
+    size_t labels = 0;
+    size_t pseudoExpansions = 0;   // nop/move/li occurrences expanded
+    size_t peepholeRemoved = 0;    // instructions deleted by -O
+    size_t peepholeRewritten = 0;  // instructions replaced by -O
+    size_t branchesRelaxed = 0;    // out-of-range branches rewritten
+    uint64_t outputBytes = 0;
+};
+
+// Allocation counting is off until enabled, so an assembly without --stats
+// pays one relaxed atomic load per operator new. Calling this links in a
+// counting global operator new; programs that never call it keep their
+// own. The counters are process-wide: with several files in flight, a
+// stage's counts include allocations made concurrently by other files.
+void enableAllocationCounting();
+
+// Times one stage and attributes the allocations made during it. Does
+// nothing when `stats` is null.
+class StageTimer {
+public:
+    StageTimer(AssemblyStats *stats, const char *name);
+    ~StageTimer();
+
+    StageTimer(const StageTimer &) = delete;
+    StageTimer &operator=(const StageTimer &) = delete;
+
+private:
+    AssemblyStats *stats_;
+    const char *name_;
+    std::chrono::steady_clock::time_point start_;
+    uint64_t startAllocations_ = 0;
+    uint64_t startBytes_ = 0;
+};
+
+// Human-readable table, reported as Info diagnostics.
+void reportStats(const AssemblyStats &stats);
+
+// All runs as one JSON document: {"files":[...]}.
+bool writeStatsJson(const std::vector<AssemblyStats> &runs, const std::string &path);
+
+#endif
@@ -0,0 +1,64 @@
+#include "symtab.h"
+
+uint32_t SymbolTable::hashName(std::string_view name) {
+    // FNV-1a
+    uint32_t h = 2166136261u;
+    for (char c : name) {
+        h ^= static_cast<uint8_t>(c);
+        h *= 16777619u;
+    }
+    return h;
+}
+
+uint32_t SymbolTable::find(std::string_view name) const {
+    if (slots_.empty()) return NONE;
+    uint32_t h = hashName(name);
+    size_t mask = slots_.size() - 1;
+    for (size_t s = h & mask;; s = (s + 1) & mask) {
+        uint32_t idx = slots_[s];
+        if (idx == NONE) return NONE;
+        const Entry &e = entries_[idx];
+        if (e.hash == h && e.name == name) return idx;
+    }
+}
+
+uint32_t SymbolTable::intern(std::string_view name) {
+    if ((entries_.size() + 1) * 2 > slots_.size()) grow();
+
+    uint32_t h = hashName(name);
+    size_t mask = slots_.size() - 1;
+    size_t s = h & mask;
+    for (;; s = (s + 1) & mask) {
+        uint32_t idx = slots_[s];
+        if (idx == NONE) break;
+        const Entry &e = entries_[idx];
+        if (e.hash == h && e.name == name) return idx;
+    }
+
+    uint32_t id = static_cast<uint32_t>(entries_.size());
+    entries_.push_back({name, h, UNDEFINED, false});
+    slots_[s] = id;
+    return id;
+}
+
+void SymbolTable::grow() {
+    size_t n = slots_.empty() ? 64 : slots_.size() * 2;
+    slots_.assign(n, NONE);
+    size_t mask = n - 1;
+    for (uint32_t id = 0; id < entries_.size(); id++) {
+        size_t s = entries_[id].hash & mask;
+        while (slots_[s] != NONE) s = (s + 1) & mask;
+        slots_[s] = id;
+    }
+}
+
+size_t SymbolTable::definedCount() const {
+    size_t n = 0;
+    for (const auto &e : entries_) n += e.address != UNDEFINED;
+    return n;
+}
+
+void SymbolTable::clear() {
+    entries_.clear();
+    slots_.clear();
+}
@@ -0,0 +1,60 @@
+#ifndef SYMTAB_H
+#define SYMTAB_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// Label names interned to dense integer IDs. Lookup is a flat
+// open-addressing hash (linear probing, load factor at most 1/2), so
+// resolving a name costs one hash and usually one probe, and resolving an
+// ID costs one array load. Names are views and must outlive the table.
+class SymbolTable {
+public:
+    static constexpr uint32_t NONE = UINT32_MAX;
+    static constexpr int UNDEFINED = -1;
+
+    // ID for name, adding it if new
+    uint32_t intern(std::string_view name);
+
+    // ID for name, or NONE
+    uint32_t find(std::string_view name) const;
+
+    std::string_view name(uint32_t id) const { return entries_[id].name; }
+    size_t size() const { return entries_.size(); }
+
+    // Address bound to a symbol, or UNDEFINED
+    int address(uint32_t id) const { return entries_[id].address; }
+    bool isDefined(uint32_t id) const { return entries_[id].address != UNDEFINED; }
+    void define(uint32_t id, int address) {
+        entries_[id].address = address;
+        entries_[id].data = false;
+    }
+
+    // Bind to a byte address in the .data segment
+    void defineData(uint32_t id, int address) {
+        entries_[id].address = address;
+        entries_[id].data = true;
+    }
+    bool isData(uint32_t id) const { return entries_[id].data; }
+    size_t definedCount() const;
+
+    void clear();
+
+private:
+    struct Entry {
+        std::string_view name;
+        uint32_t hash;
+        int address;
+        bool data;   // a .data label: a byte address, not a word address
+    };
+
+    static uint32_t hashName(std::string_view name);
+    void grow();
+
+    std::vector<Entry> entries_;
+    std::vector<uint32_t> slots_;   // entry index, or NONE for empty
+};
+
+#endif